@@ -1,11 +1,21 @@
+#define _POSIX_C_SOURCE 200809L
+
 #include <assert.h>
-#include <ctype.h>
+#include <fcntl.h>
+#include <inttypes.h>
+#include <pthread.h>
+#include <sched.h>
+#include <stdatomic.h>
 #include <stdbool.h>
 #include <stddef.h>
 #include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
 
 void unused() {}
 
@@ -52,6 +62,7 @@ typedef enum Token_Kind {
     Token_Kind__Else,
     Token_Kind__End,
     Token_Kind__Exists,
+    Token_Kind__Filter,
     Token_Kind__Foreign,
     Token_Kind__From,
     Token_Kind__Full,
@@ -116,7 +127,7 @@ typedef struct Token {
     Token_Kind  kind;
     size_t position;
     uint32_t line;
-    uint32_t offset;
+    uint32_t offset; /* Bytes from the start of the line, counted in characters only once the token is mapped. */
     char *literal;
     size_t literal_length;
 } Token;
@@ -126,15 +137,20 @@ typedef struct Lexer {
     const char *end;
     const char *head;
     const char *line_start;
+    const char *line_scan; /* How far newlines were counted. */
+    const char *validated; /* How far the input is known to be valid UTF-8. */
     size_t line;
     Token *tokens;
     size_t tokens_used;
     size_t tokens_allocated;
     Token *next_token;
     Arena *strings;
+    bool batch_continues_statement;
+    bool batch_cuts_statement;
 } Lexer;
 
 typedef enum Lexer_Status {
+    Lexer_Status__Invalid_Utf8 = -6,
     Lexer_Status__Unclosed_String = -5,
     Lexer_Status__Invalid_Number = -4,
     Lexer_Status__Invalid_String = -3,
@@ -144,6 +160,135 @@ typedef enum Lexer_Status {
     Lexer_Status__Token_Found = 1,
 } Lexer_Status;
 
+#define BATCH_SIZE 1024 /* Tokens after which a batch ends with the next statement. */
+#define BATCH_LIMIT 4096 /* Tokens after which a batch is cut, even inside a statement. */
+#define BATCH_RING_CAPACITY 4
+#define BATCH_RING_SPINS 64 /* Yields before a waiting stage parks until the other side moves. */
+
+typedef struct Token_Batch {
+    Token *tokens;
+    size_t tokens_used;
+    size_t tokens_allocated;
+    Arena *strings;
+    bool continues_statement; /* Starts inside a statement cut at the end of the previous batch. */
+    bool cuts_statement; /* Ends inside a statement that continues in the next batch. */
+    Lexer_Status status; /* Token_Found while more batches follow. */
+} Token_Batch;
+
+/* Lock-free ring of batches between one producer and one consumer thread. Slots keep their buffers, which
+ * circulate between stages by swapping, and a full ring holds the producer back. The lock is only taken by a side
+ * that waited too long, and by the other side to wake it. */
+typedef struct Batch_Ring {
+    Token_Batch slots[BATCH_RING_CAPACITY];
+    atomic_size_t head; /* Batches consumed, only advanced by the consumer. */
+    atomic_size_t tail; /* Batches produced, only advanced by the producer. */
+    atomic_bool producer_parked;
+    atomic_bool consumer_parked;
+    pthread_mutex_t lock;
+    pthread_cond_t moved;
+} Batch_Ring;
+
+typedef enum Dialect {
+    Dialect__Postgres,
+    Dialect__Oracle,
+    Dialect__MySql,
+} Dialect;
+
+typedef enum Rewrite_Rule {
+    Rewrite_Rule__Fold_Constants,
+    Rewrite_Rule__Count_Case_To_Filter,
+    Rewrite_Rule__Drop_Grouped_Distinct,
+    Rewrite_Rule__Total,
+} Rewrite_Rule;
+
+typedef struct Rewrite_Report {
+    size_t fired[Rewrite_Rule__Total];
+} Rewrite_Report;
+
+typedef struct Source_Mapping {
+    size_t offset; /* Characters before the token in the emitted SQL, as databases count error positions. */
+    uint32_t line;
+    uint32_t column;
+} Source_Mapping;
+
+typedef struct Source_Map_Writer {
+    FILE *output;
+    Source_Mapping previous;
+    size_t mappings_written;
+    size_t buffer_used;
+    uint8_t buffer[4096];
+} Source_Map_Writer;
+
+typedef struct Source_Map_Checkpoint {
+    size_t data_offset; /* Where the mapping after this one starts. */
+    Source_Mapping mapping;
+} Source_Map_Checkpoint;
+
+typedef struct Source_Map {
+    uint8_t *data;
+    size_t data_length;
+    Source_Map_Checkpoint *checkpoints;
+    size_t checkpoints_used;
+    size_t emitted_length; /* Offsets past the emitted SQL are not mapped. */
+} Source_Map;
+
+typedef enum Emit_Class {
+    Emit_Class__None = 0,
+    Emit_Class__Word, /* Keywords, unquoted identifiers and numbers. */
+    Emit_Class__Quoted, /* "Quoted identifiers" and 'text'. */
+    Emit_Class__Operator, /* = <> || and the like. */
+    Emit_Class__Punctuation, /* , . ( ) ; */
+} Emit_Class;
+
+typedef struct Statement_Key {
+    uint64_t hash;
+    size_t length;
+    const char *text;
+} Statement_Key;
+
+typedef struct Emitter {
+    FILE *output;
+    size_t written; /* In characters when writing a source map, whose offsets count them, in bytes otherwise. */
+    Emit_Class previous_class;
+    Token_Kind previous_kind;
+    bool deduplicate;
+    char *statement;
+    size_t statement_used;
+    size_t statement_allocated;
+    size_t statement_written; /* Characters in the buffered statement. */
+    Emit_Class statement_previous_class;
+    Token_Kind statement_previous_kind;
+    Source_Map_Writer *source_map;
+    size_t source_ascii_begin; /* The input between these positions is known to be ASCII. */
+    size_t source_ascii_end;
+    bool batch_ascii; /* Whether the whole batch being written lies in there, */
+    bool token_ascii; /* or at least the token being written, with its literal. */
+    uint32_t source_line; /* Where the last token counted in characters starts in the input, */
+    size_t source_position;
+    uint32_t source_column; /* and its column. */
+    Source_Mapping *statement_mappings;
+    size_t statement_mappings_used;
+    size_t statement_mappings_allocated;
+    Statement_Key *seen; /* Statements emitted since the current batch began. */
+    size_t seen_used;
+    size_t seen_allocated;
+    Arena *seen_texts;
+    size_t statements_dropped;
+} Emitter;
+
+/* Lexes, optionally rewrites, then emits or dumps batches, either one after the other or as a pipeline with a
+ * thread per stage. */
+typedef struct Transpiler {
+    Lexer *lexer;
+    bool rewrite;
+    Dialect dialect;
+    Rewrite_Report report;
+    Emitter *emitter; /* Tokens are dumped instead when NULL. */
+    size_t tokens_generated;
+    Batch_Ring lexed;
+    Batch_Ring rewritten;
+} Transpiler;
+
 char to_lower_ascii(char character)
 {
     const char offset = 'a' - 'A';
@@ -151,6 +296,21 @@ char to_lower_ascii(char character)
     return character;
 }
 
+bool is_digit_ascii(char character)
+{
+    return '0' <= character && character <= '9';
+}
+
+bool is_alpha_ascii(char character)
+{
+    return ('a' <= character && character <= 'z') || ('A' <= character && character <= 'Z');
+}
+
+bool is_space_ascii(char character)
+{
+    return character == ' ' || ('\t' <= character && character <= '\r');
+}
+
 bool strings_equal_caseless(const char *first, const char *second, size_t length)
 {
     for (size_t i = 0; i < length; ++i) {
@@ -159,6 +319,333 @@ bool strings_equal_caseless(const char *first, const char *second, size_t length
     return true;
 }
 
+/* Returns the size of the UTF-8 sequence starting at bytes, or 0 if it is truncated, overlong, a surrogate or
+ * beyond U+10FFFF. */
+size_t utf8_sequence_size(const uint8_t *bytes, const uint8_t *end)
+{
+    size_t available = end - bytes;
+    uint8_t lead = bytes[0];
+
+    if (lead < 0x80) return 1;
+    if (lead < 0xC2) return 0; /* Stray continuation byte or overlong lead. */
+    if (lead < 0xE0) return (available >= 2 && (bytes[1] & 0xC0) == 0x80) ? 2 : 0;
+    if (lead < 0xF0) {
+        if (available < 3 || (bytes[1] & 0xC0) != 0x80 || (bytes[2] & 0xC0) != 0x80) return 0;
+        if (lead == 0xE0 && bytes[1] < 0xA0) return 0; /* Overlong. */
+        if (lead == 0xED && bytes[1] >= 0xA0) return 0; /* Surrogate. */
+        return 3;
+    }
+    if (lead < 0xF5) {
+        if (available < 4 || (bytes[1] & 0xC0) != 0x80 || (bytes[2] & 0xC0) != 0x80 || (bytes[3] & 0xC0) != 0x80) return 0;
+        if (lead == 0xF0 && bytes[1] < 0x90) return 0; /* Overlong. */
+        if (lead == 0xF4 && bytes[1] >= 0x90) return 0; /* Beyond U+10FFFF. */
+        return 4;
+    }
+    return 0;
+}
+
+/* Returns the length of the longest valid UTF-8 prefix of source, which stops short of a truncated sequence. */
+size_t utf8_valid_prefix(const char *source, size_t length)
+{
+    const uint8_t *head = (const uint8_t *)source;
+    const uint8_t *end = head + length;
+
+    while (head < end) {
+        /* Skip ASCII eight bytes at a time, only decoding when some high bit is set. */
+        if (end - head >= 8) {
+            uint64_t word;
+            memcpy(&word, head, sizeof word);
+            if ((word & 0x8080808080808080ull) == 0) {
+                head += 8;
+                continue;
+            }
+        }
+
+        if (head[0] < 0x80) {
+            ++head;
+            continue;
+        }
+
+        size_t size = utf8_sequence_size(head, end);
+        if (size == 0) break;
+        head += size;
+    }
+
+    return head - (const uint8_t *)source;
+}
+
+bool utf8_is_valid(const char *source, size_t length)
+{
+    return utf8_valid_prefix(source, length) == length;
+}
+
+/* Returns the length of the ASCII prefix of source. */
+size_t ascii_prefix(const char *source, size_t length)
+{
+    const uint8_t *head = (const uint8_t *)source;
+    const uint8_t *end = head + length;
+
+    for (; end - head >= 8; head += 8) {
+        uint64_t word;
+        memcpy(&word, head, sizeof word);
+        if ((word & 0x8080808080808080ull) != 0) break;
+    }
+    while (head < end && head[0] < 0x80) ++head;
+
+    return head - (const uint8_t *)source;
+}
+
+/* Counts the runes in source as its length minus the continuation bytes, 10xxxxxx, found eight at a time. */
+size_t utf8_count_runes(const char *source, size_t length)
+{
+    const uint8_t *head = (const uint8_t *)source;
+    const uint8_t *end = head + length;
+    size_t continuations = 0;
+
+    for (; end - head >= 8; head += 8) {
+        uint64_t word;
+        memcpy(&word, head, sizeof word);
+        uint64_t marks = (word & ~(word << 1) & 0x8080808080808080ull) >> 7;
+        continuations += (marks * 0x0101010101010101ull) >> 56;
+    }
+    for (; head < end; ++head) continuations += (head[0] & 0xC0) == 0x80;
+
+    return length - continuations;
+}
+
+/* Decodes the rune starting at source, which must be valid UTF-8, and returns its size in bytes. */
+size_t utf8_decode(const char *source, uint32_t *rune)
+{
+    const uint8_t *bytes = (const uint8_t *)source;
+
+    if (bytes[0] < 0x80) {
+        *rune = bytes[0];
+        return 1;
+    }
+    if (bytes[0] < 0xE0) {
+        *rune = (uint32_t)(bytes[0] & 0x1F) << 6 | (bytes[1] & 0x3F);
+        return 2;
+    }
+    if (bytes[0] < 0xF0) {
+        *rune = (uint32_t)(bytes[0] & 0x0F) << 12 | (uint32_t)(bytes[1] & 0x3F) << 6 | (bytes[2] & 0x3F);
+        return 3;
+    }
+    *rune = (uint32_t)(bytes[0] & 0x07) << 18 | (uint32_t)(bytes[1] & 0x3F) << 12 | (uint32_t)(bytes[2] & 0x3F) << 6 | (bytes[3] & 0x3F);
+    return 4;
+}
+
+typedef struct Rune_Range {
+    uint32_t first;
+    uint32_t last;
+} Rune_Range;
+
+/* Non-ASCII runes that may start an identifier: the SQL identifier start set, general categories Lu, Ll, Lt,
+ * Lm, Lo and Nl, as of Unicode 14.0.0. */
+static const Rune_Range identifier_start_runes[] = {
+    {0x00AA, 0x00AA}, {0x00B5, 0x00B5}, {0x00BA, 0x00BA}, {0x00C0, 0x00D6}, {0x00D8, 0x00F6}, {0x00F8, 0x02C1},
+    {0x02C6, 0x02D1}, {0x02E0, 0x02E4}, {0x02EC, 0x02EC}, {0x02EE, 0x02EE}, {0x0370, 0x0374}, {0x0376, 0x0377},
+    {0x037A, 0x037D}, {0x037F, 0x037F}, {0x0386, 0x0386}, {0x0388, 0x038A}, {0x038C, 0x038C}, {0x038E, 0x03A1},
+    {0x03A3, 0x03F5}, {0x03F7, 0x0481}, {0x048A, 0x052F}, {0x0531, 0x0556}, {0x0559, 0x0559}, {0x0560, 0x0588},
+    {0x05D0, 0x05EA}, {0x05EF, 0x05F2}, {0x0620, 0x064A}, {0x066E, 0x066F}, {0x0671, 0x06D3}, {0x06D5, 0x06D5},
+    {0x06E5, 0x06E6}, {0x06EE, 0x06EF}, {0x06FA, 0x06FC}, {0x06FF, 0x06FF}, {0x0710, 0x0710}, {0x0712, 0x072F},
+    {0x074D, 0x07A5}, {0x07B1, 0x07B1}, {0x07CA, 0x07EA}, {0x07F4, 0x07F5}, {0x07FA, 0x07FA}, {0x0800, 0x0815},
+    {0x081A, 0x081A}, {0x0824, 0x0824}, {0x0828, 0x0828}, {0x0840, 0x0858}, {0x0860, 0x086A}, {0x0870, 0x0887},
+    {0x0889, 0x088E}, {0x08A0, 0x08C9}, {0x0904, 0x0939}, {0x093D, 0x093D}, {0x0950, 0x0950}, {0x0958, 0x0961},
+    {0x0971, 0x0980}, {0x0985, 0x098C}, {0x098F, 0x0990}, {0x0993, 0x09A8}, {0x09AA, 0x09B0}, {0x09B2, 0x09B2},
+    {0x09B6, 0x09B9}, {0x09BD, 0x09BD}, {0x09CE, 0x09CE}, {0x09DC, 0x09DD}, {0x09DF, 0x09E1}, {0x09F0, 0x09F1},
+    {0x09FC, 0x09FC}, {0x0A05, 0x0A0A}, {0x0A0F, 0x0A10}, {0x0A13, 0x0A28}, {0x0A2A, 0x0A30}, {0x0A32, 0x0A33},
+    {0x0A35, 0x0A36}, {0x0A38, 0x0A39}, {0x0A59, 0x0A5C}, {0x0A5E, 0x0A5E}, {0x0A72, 0x0A74}, {0x0A85, 0x0A8D},
+    {0x0A8F, 0x0A91}, {0x0A93, 0x0AA8}, {0x0AAA, 0x0AB0}, {0x0AB2, 0x0AB3}, {0x0AB5, 0x0AB9}, {0x0ABD, 0x0ABD},
+    {0x0AD0, 0x0AD0}, {0x0AE0, 0x0AE1}, {0x0AF9, 0x0AF9}, {0x0B05, 0x0B0C}, {0x0B0F, 0x0B10}, {0x0B13, 0x0B28},
+    {0x0B2A, 0x0B30}, {0x0B32, 0x0B33}, {0x0B35, 0x0B39}, {0x0B3D, 0x0B3D}, {0x0B5C, 0x0B5D}, {0x0B5F, 0x0B61},
+    {0x0B71, 0x0B71}, {0x0B83, 0x0B83}, {0x0B85, 0x0B8A}, {0x0B8E, 0x0B90}, {0x0B92, 0x0B95}, {0x0B99, 0x0B9A},
+    {0x0B9C, 0x0B9C}, {0x0B9E, 0x0B9F}, {0x0BA3, 0x0BA4}, {0x0BA8, 0x0BAA}, {0x0BAE, 0x0BB9}, {0x0BD0, 0x0BD0},
+    {0x0C05, 0x0C0C}, {0x0C0E, 0x0C10}, {0x0C12, 0x0C28}, {0x0C2A, 0x0C39}, {0x0C3D, 0x0C3D}, {0x0C58, 0x0C5A},
+    {0x0C5D, 0x0C5D}, {0x0C60, 0x0C61}, {0x0C80, 0x0C80}, {0x0C85, 0x0C8C}, {0x0C8E, 0x0C90}, {0x0C92, 0x0CA8},
+    {0x0CAA, 0x0CB3}, {0x0CB5, 0x0CB9}, {0x0CBD, 0x0CBD}, {0x0CDD, 0x0CDE}, {0x0CE0, 0x0CE1}, {0x0CF1, 0x0CF2},
+    {0x0D04, 0x0D0C}, {0x0D0E, 0x0D10}, {0x0D12, 0x0D3A}, {0x0D3D, 0x0D3D}, {0x0D4E, 0x0D4E}, {0x0D54, 0x0D56},
+    {0x0D5F, 0x0D61}, {0x0D7A, 0x0D7F}, {0x0D85, 0x0D96}, {0x0D9A, 0x0DB1}, {0x0DB3, 0x0DBB}, {0x0DBD, 0x0DBD},
+    {0x0DC0, 0x0DC6}, {0x0E01, 0x0E30}, {0x0E32, 0x0E33}, {0x0E40, 0x0E46}, {0x0E81, 0x0E82}, {0x0E84, 0x0E84},
+    {0x0E86, 0x0E8A}, {0x0E8C, 0x0EA3}, {0x0EA5, 0x0EA5}, {0x0EA7, 0x0EB0}, {0x0EB2, 0x0EB3}, {0x0EBD, 0x0EBD},
+    {0x0EC0, 0x0EC4}, {0x0EC6, 0x0EC6}, {0x0EDC, 0x0EDF}, {0x0F00, 0x0F00}, {0x0F40, 0x0F47}, {0x0F49, 0x0F6C},
+    {0x0F88, 0x0F8C}, {0x1000, 0x102A}, {0x103F, 0x103F}, {0x1050, 0x1055}, {0x105A, 0x105D}, {0x1061, 0x1061},
+    {0x1065, 0x1066}, {0x106E, 0x1070}, {0x1075, 0x1081}, {0x108E, 0x108E}, {0x10A0, 0x10C5}, {0x10C7, 0x10C7},
+    {0x10CD, 0x10CD}, {0x10D0, 0x10FA}, {0x10FC, 0x1248}, {0x124A, 0x124D}, {0x1250, 0x1256}, {0x1258, 0x1258},
+    {0x125A, 0x125D}, {0x1260, 0x1288}, {0x128A, 0x128D}, {0x1290, 0x12B0}, {0x12B2, 0x12B5}, {0x12B8, 0x12BE},
+    {0x12C0, 0x12C0}, {0x12C2, 0x12C5}, {0x12C8, 0x12D6}, {0x12D8, 0x1310}, {0x1312, 0x1315}, {0x1318, 0x135A},
+    {0x1380, 0x138F}, {0x13A0, 0x13F5}, {0x13F8, 0x13FD}, {0x1401, 0x166C}, {0x166F, 0x167F}, {0x1681, 0x169A},
+    {0x16A0, 0x16EA}, {0x16EE, 0x16F8}, {0x1700, 0x1711}, {0x171F, 0x1731}, {0x1740, 0x1751}, {0x1760, 0x176C},
+    {0x176E, 0x1770}, {0x1780, 0x17B3}, {0x17D7, 0x17D7}, {0x17DC, 0x17DC}, {0x1820, 0x1878}, {0x1880, 0x1884},
+    {0x1887, 0x18A8}, {0x18AA, 0x18AA}, {0x18B0, 0x18F5}, {0x1900, 0x191E}, {0x1950, 0x196D}, {0x1970, 0x1974},
+    {0x1980, 0x19AB}, {0x19B0, 0x19C9}, {0x1A00, 0x1A16}, {0x1A20, 0x1A54}, {0x1AA7, 0x1AA7}, {0x1B05, 0x1B33},
+    {0x1B45, 0x1B4C}, {0x1B83, 0x1BA0}, {0x1BAE, 0x1BAF}, {0x1BBA, 0x1BE5}, {0x1C00, 0x1C23}, {0x1C4D, 0x1C4F},
+    {0x1C5A, 0x1C7D}, {0x1C80, 0x1C88}, {0x1C90, 0x1CBA}, {0x1CBD, 0x1CBF}, {0x1CE9, 0x1CEC}, {0x1CEE, 0x1CF3},
+    {0x1CF5, 0x1CF6}, {0x1CFA, 0x1CFA}, {0x1D00, 0x1DBF}, {0x1E00, 0x1F15}, {0x1F18, 0x1F1D}, {0x1F20, 0x1F45},
+    {0x1F48, 0x1F4D}, {0x1F50, 0x1F57}, {0x1F59, 0x1F59}, {0x1F5B, 0x1F5B}, {0x1F5D, 0x1F5D}, {0x1F5F, 0x1F7D},
+    {0x1F80, 0x1FB4}, {0x1FB6, 0x1FBC}, {0x1FBE, 0x1FBE}, {0x1FC2, 0x1FC4}, {0x1FC6, 0x1FCC}, {0x1FD0, 0x1FD3},
+    {0x1FD6, 0x1FDB}, {0x1FE0, 0x1FEC}, {0x1FF2, 0x1FF4}, {0x1FF6, 0x1FFC}, {0x2071, 0x2071}, {0x207F, 0x207F},
+    {0x2090, 0x209C}, {0x2102, 0x2102}, {0x2107, 0x2107}, {0x210A, 0x2113}, {0x2115, 0x2115}, {0x2119, 0x211D},
+    {0x2124, 0x2124}, {0x2126, 0x2126}, {0x2128, 0x2128}, {0x212A, 0x212D}, {0x212F, 0x2139}, {0x213C, 0x213F},
+    {0x2145, 0x2149}, {0x214E, 0x214E}, {0x2160, 0x2188}, {0x2C00, 0x2CE4}, {0x2CEB, 0x2CEE}, {0x2CF2, 0x2CF3},
+    {0x2D00, 0x2D25}, {0x2D27, 0x2D27}, {0x2D2D, 0x2D2D}, {0x2D30, 0x2D67}, {0x2D6F, 0x2D6F}, {0x2D80, 0x2D96},
+    {0x2DA0, 0x2DA6}, {0x2DA8, 0x2DAE}, {0x2DB0, 0x2DB6}, {0x2DB8, 0x2DBE}, {0x2DC0, 0x2DC6}, {0x2DC8, 0x2DCE},
+    {0x2DD0, 0x2DD6}, {0x2DD8, 0x2DDE}, {0x2E2F, 0x2E2F}, {0x3005, 0x3007}, {0x3021, 0x3029}, {0x3031, 0x3035},
+    {0x3038, 0x303C}, {0x3041, 0x3096}, {0x309D, 0x309F}, {0x30A1, 0x30FA}, {0x30FC, 0x30FF}, {0x3105, 0x312F},
+    {0x3131, 0x318E}, {0x31A0, 0x31BF}, {0x31F0, 0x31FF}, {0x3400, 0x4DBF}, {0x4E00, 0xA48C}, {0xA4D0, 0xA4FD},
+    {0xA500, 0xA60C}, {0xA610, 0xA61F}, {0xA62A, 0xA62B}, {0xA640, 0xA66E}, {0xA67F, 0xA69D}, {0xA6A0, 0xA6EF},
+    {0xA717, 0xA71F}, {0xA722, 0xA788}, {0xA78B, 0xA7CA}, {0xA7D0, 0xA7D1}, {0xA7D3, 0xA7D3}, {0xA7D5, 0xA7D9},
+    {0xA7F2, 0xA801}, {0xA803, 0xA805}, {0xA807, 0xA80A}, {0xA80C, 0xA822}, {0xA840, 0xA873}, {0xA882, 0xA8B3},
+    {0xA8F2, 0xA8F7}, {0xA8FB, 0xA8FB}, {0xA8FD, 0xA8FE}, {0xA90A, 0xA925}, {0xA930, 0xA946}, {0xA960, 0xA97C},
+    {0xA984, 0xA9B2}, {0xA9CF, 0xA9CF}, {0xA9E0, 0xA9E4}, {0xA9E6, 0xA9EF}, {0xA9FA, 0xA9FE}, {0xAA00, 0xAA28},
+    {0xAA40, 0xAA42}, {0xAA44, 0xAA4B}, {0xAA60, 0xAA76}, {0xAA7A, 0xAA7A}, {0xAA7E, 0xAAAF}, {0xAAB1, 0xAAB1},
+    {0xAAB5, 0xAAB6}, {0xAAB9, 0xAABD}, {0xAAC0, 0xAAC0}, {0xAAC2, 0xAAC2}, {0xAADB, 0xAADD}, {0xAAE0, 0xAAEA},
+    {0xAAF2, 0xAAF4}, {0xAB01, 0xAB06}, {0xAB09, 0xAB0E}, {0xAB11, 0xAB16}, {0xAB20, 0xAB26}, {0xAB28, 0xAB2E},
+    {0xAB30, 0xAB5A}, {0xAB5C, 0xAB69}, {0xAB70, 0xABE2}, {0xAC00, 0xD7A3}, {0xD7B0, 0xD7C6}, {0xD7CB, 0xD7FB},
+    {0xF900, 0xFA6D}, {0xFA70, 0xFAD9}, {0xFB00, 0xFB06}, {0xFB13, 0xFB17}, {0xFB1D, 0xFB1D}, {0xFB1F, 0xFB28},
+    {0xFB2A, 0xFB36}, {0xFB38, 0xFB3C}, {0xFB3E, 0xFB3E}, {0xFB40, 0xFB41}, {0xFB43, 0xFB44}, {0xFB46, 0xFBB1},
+    {0xFBD3, 0xFD3D}, {0xFD50, 0xFD8F}, {0xFD92, 0xFDC7}, {0xFDF0, 0xFDFB}, {0xFE70, 0xFE74}, {0xFE76, 0xFEFC},
+    {0xFF21, 0xFF3A}, {0xFF41, 0xFF5A}, {0xFF66, 0xFFBE}, {0xFFC2, 0xFFC7}, {0xFFCA, 0xFFCF}, {0xFFD2, 0xFFD7},
+    {0xFFDA, 0xFFDC}, {0x10000, 0x1000B}, {0x1000D, 0x10026}, {0x10028, 0x1003A}, {0x1003C, 0x1003D},
+    {0x1003F, 0x1004D}, {0x10050, 0x1005D}, {0x10080, 0x100FA}, {0x10140, 0x10174}, {0x10280, 0x1029C},
+    {0x102A0, 0x102D0}, {0x10300, 0x1031F}, {0x1032D, 0x1034A}, {0x10350, 0x10375}, {0x10380, 0x1039D},
+    {0x103A0, 0x103C3}, {0x103C8, 0x103CF}, {0x103D1, 0x103D5}, {0x10400, 0x1049D}, {0x104B0, 0x104D3},
+    {0x104D8, 0x104FB}, {0x10500, 0x10527}, {0x10530, 0x10563}, {0x10570, 0x1057A}, {0x1057C, 0x1058A},
+    {0x1058C, 0x10592}, {0x10594, 0x10595}, {0x10597, 0x105A1}, {0x105A3, 0x105B1}, {0x105B3, 0x105B9},
+    {0x105BB, 0x105BC}, {0x10600, 0x10736}, {0x10740, 0x10755}, {0x10760, 0x10767}, {0x10780, 0x10785},
+    {0x10787, 0x107B0}, {0x107B2, 0x107BA}, {0x10800, 0x10805}, {0x10808, 0x10808}, {0x1080A, 0x10835},
+    {0x10837, 0x10838}, {0x1083C, 0x1083C}, {0x1083F, 0x10855}, {0x10860, 0x10876}, {0x10880, 0x1089E},
+    {0x108E0, 0x108F2}, {0x108F4, 0x108F5}, {0x10900, 0x10915}, {0x10920, 0x10939}, {0x10980, 0x109B7},
+    {0x109BE, 0x109BF}, {0x10A00, 0x10A00}, {0x10A10, 0x10A13}, {0x10A15, 0x10A17}, {0x10A19, 0x10A35},
+    {0x10A60, 0x10A7C}, {0x10A80, 0x10A9C}, {0x10AC0, 0x10AC7}, {0x10AC9, 0x10AE4}, {0x10B00, 0x10B35},
+    {0x10B40, 0x10B55}, {0x10B60, 0x10B72}, {0x10B80, 0x10B91}, {0x10C00, 0x10C48}, {0x10C80, 0x10CB2},
+    {0x10CC0, 0x10CF2}, {0x10D00, 0x10D23}, {0x10E80, 0x10EA9}, {0x10EB0, 0x10EB1}, {0x10F00, 0x10F1C},
+    {0x10F27, 0x10F27}, {0x10F30, 0x10F45}, {0x10F70, 0x10F81}, {0x10FB0, 0x10FC4}, {0x10FE0, 0x10FF6},
+    {0x11003, 0x11037}, {0x11071, 0x11072}, {0x11075, 0x11075}, {0x11083, 0x110AF}, {0x110D0, 0x110E8},
+    {0x11103, 0x11126}, {0x11144, 0x11144}, {0x11147, 0x11147}, {0x11150, 0x11172}, {0x11176, 0x11176},
+    {0x11183, 0x111B2}, {0x111C1, 0x111C4}, {0x111DA, 0x111DA}, {0x111DC, 0x111DC}, {0x11200, 0x11211},
+    {0x11213, 0x1122B}, {0x11280, 0x11286}, {0x11288, 0x11288}, {0x1128A, 0x1128D}, {0x1128F, 0x1129D},
+    {0x1129F, 0x112A8}, {0x112B0, 0x112DE}, {0x11305, 0x1130C}, {0x1130F, 0x11310}, {0x11313, 0x11328},
+    {0x1132A, 0x11330}, {0x11332, 0x11333}, {0x11335, 0x11339}, {0x1133D, 0x1133D}, {0x11350, 0x11350},
+    {0x1135D, 0x11361}, {0x11400, 0x11434}, {0x11447, 0x1144A}, {0x1145F, 0x11461}, {0x11480, 0x114AF},
+    {0x114C4, 0x114C5}, {0x114C7, 0x114C7}, {0x11580, 0x115AE}, {0x115D8, 0x115DB}, {0x11600, 0x1162F},
+    {0x11644, 0x11644}, {0x11680, 0x116AA}, {0x116B8, 0x116B8}, {0x11700, 0x1171A}, {0x11740, 0x11746},
+    {0x11800, 0x1182B}, {0x118A0, 0x118DF}, {0x118FF, 0x11906}, {0x11909, 0x11909}, {0x1190C, 0x11913},
+    {0x11915, 0x11916}, {0x11918, 0x1192F}, {0x1193F, 0x1193F}, {0x11941, 0x11941}, {0x119A0, 0x119A7},
+    {0x119AA, 0x119D0}, {0x119E1, 0x119E1}, {0x119E3, 0x119E3}, {0x11A00, 0x11A00}, {0x11A0B, 0x11A32},
+    {0x11A3A, 0x11A3A}, {0x11A50, 0x11A50}, {0x11A5C, 0x11A89}, {0x11A9D, 0x11A9D}, {0x11AB0, 0x11AF8},
+    {0x11C00, 0x11C08}, {0x11C0A, 0x11C2E}, {0x11C40, 0x11C40}, {0x11C72, 0x11C8F}, {0x11D00, 0x11D06},
+    {0x11D08, 0x11D09}, {0x11D0B, 0x11D30}, {0x11D46, 0x11D46}, {0x11D60, 0x11D65}, {0x11D67, 0x11D68},
+    {0x11D6A, 0x11D89}, {0x11D98, 0x11D98}, {0x11EE0, 0x11EF2}, {0x11FB0, 0x11FB0}, {0x12000, 0x12399},
+    {0x12400, 0x1246E}, {0x12480, 0x12543}, {0x12F90, 0x12FF0}, {0x13000, 0x1342E}, {0x14400, 0x14646},
+    {0x16800, 0x16A38}, {0x16A40, 0x16A5E}, {0x16A70, 0x16ABE}, {0x16AD0, 0x16AED}, {0x16B00, 0x16B2F},
+    {0x16B40, 0x16B43}, {0x16B63, 0x16B77}, {0x16B7D, 0x16B8F}, {0x16E40, 0x16E7F}, {0x16F00, 0x16F4A},
+    {0x16F50, 0x16F50}, {0x16F93, 0x16F9F}, {0x16FE0, 0x16FE1}, {0x16FE3, 0x16FE3}, {0x17000, 0x187F7},
+    {0x18800, 0x18CD5}, {0x18D00, 0x18D08}, {0x1AFF0, 0x1AFF3}, {0x1AFF5, 0x1AFFB}, {0x1AFFD, 0x1AFFE},
+    {0x1B000, 0x1B122}, {0x1B150, 0x1B152}, {0x1B164, 0x1B167}, {0x1B170, 0x1B2FB}, {0x1BC00, 0x1BC6A},
+    {0x1BC70, 0x1BC7C}, {0x1BC80, 0x1BC88}, {0x1BC90, 0x1BC99}, {0x1D400, 0x1D454}, {0x1D456, 0x1D49C},
+    {0x1D49E, 0x1D49F}, {0x1D4A2, 0x1D4A2}, {0x1D4A5, 0x1D4A6}, {0x1D4A9, 0x1D4AC}, {0x1D4AE, 0x1D4B9},
+    {0x1D4BB, 0x1D4BB}, {0x1D4BD, 0x1D4C3}, {0x1D4C5, 0x1D505}, {0x1D507, 0x1D50A}, {0x1D50D, 0x1D514},
+    {0x1D516, 0x1D51C}, {0x1D51E, 0x1D539}, {0x1D53B, 0x1D53E}, {0x1D540, 0x1D544}, {0x1D546, 0x1D546},
+    {0x1D54A, 0x1D550}, {0x1D552, 0x1D6A5}, {0x1D6A8, 0x1D6C0}, {0x1D6C2, 0x1D6DA}, {0x1D6DC, 0x1D6FA},
+    {0x1D6FC, 0x1D714}, {0x1D716, 0x1D734}, {0x1D736, 0x1D74E}, {0x1D750, 0x1D76E}, {0x1D770, 0x1D788},
+    {0x1D78A, 0x1D7A8}, {0x1D7AA, 0x1D7C2}, {0x1D7C4, 0x1D7CB}, {0x1DF00, 0x1DF1E}, {0x1E100, 0x1E12C},
+    {0x1E137, 0x1E13D}, {0x1E14E, 0x1E14E}, {0x1E290, 0x1E2AD}, {0x1E2C0, 0x1E2EB}, {0x1E7E0, 0x1E7E6},
+    {0x1E7E8, 0x1E7EB}, {0x1E7ED, 0x1E7EE}, {0x1E7F0, 0x1E7FE}, {0x1E800, 0x1E8C4}, {0x1E900, 0x1E943},
+    {0x1E94B, 0x1E94B}, {0x1EE00, 0x1EE03}, {0x1EE05, 0x1EE1F}, {0x1EE21, 0x1EE22}, {0x1EE24, 0x1EE24},
+    {0x1EE27, 0x1EE27}, {0x1EE29, 0x1EE32}, {0x1EE34, 0x1EE37}, {0x1EE39, 0x1EE39}, {0x1EE3B, 0x1EE3B},
+    {0x1EE42, 0x1EE42}, {0x1EE47, 0x1EE47}, {0x1EE49, 0x1EE49}, {0x1EE4B, 0x1EE4B}, {0x1EE4D, 0x1EE4F},
+    {0x1EE51, 0x1EE52}, {0x1EE54, 0x1EE54}, {0x1EE57, 0x1EE57}, {0x1EE59, 0x1EE59}, {0x1EE5B, 0x1EE5B},
+    {0x1EE5D, 0x1EE5D}, {0x1EE5F, 0x1EE5F}, {0x1EE61, 0x1EE62}, {0x1EE64, 0x1EE64}, {0x1EE67, 0x1EE6A},
+    {0x1EE6C, 0x1EE72}, {0x1EE74, 0x1EE77}, {0x1EE79, 0x1EE7C}, {0x1EE7E, 0x1EE7E}, {0x1EE80, 0x1EE89},
+    {0x1EE8B, 0x1EE9B}, {0x1EEA1, 0x1EEA3}, {0x1EEA5, 0x1EEA9}, {0x1EEAB, 0x1EEBB}, {0x20000, 0x2A6DF},
+    {0x2A700, 0x2B738}, {0x2B740, 0x2B81D}, {0x2B820, 0x2CEA1}, {0x2CEB0, 0x2EBE0}, {0x2F800, 0x2FA1D},
+    {0x30000, 0x3134A},
+};
+
+/* Non-ASCII runes that may only continue an identifier: the SQL identifier extend set, U+00B7 MIDDLE DOT and
+ * general categories Mn, Mc, Nd and Pc, as of Unicode 14.0.0. Format characters (Cf) are left out, except ZWNJ and
+ * ZWJ, since they are invisible and include bidirectional controls. */
+static const Rune_Range identifier_extend_runes[] = {
+    {0x00B7, 0x00B7}, {0x0300, 0x036F}, {0x0483, 0x0487}, {0x0591, 0x05BD}, {0x05BF, 0x05BF}, {0x05C1, 0x05C2},
+    {0x05C4, 0x05C5}, {0x05C7, 0x05C7}, {0x0610, 0x061A}, {0x064B, 0x0669}, {0x0670, 0x0670}, {0x06D6, 0x06DC},
+    {0x06DF, 0x06E4}, {0x06E7, 0x06E8}, {0x06EA, 0x06ED}, {0x06F0, 0x06F9}, {0x0711, 0x0711}, {0x0730, 0x074A},
+    {0x07A6, 0x07B0}, {0x07C0, 0x07C9}, {0x07EB, 0x07F3}, {0x07FD, 0x07FD}, {0x0816, 0x0819}, {0x081B, 0x0823},
+    {0x0825, 0x0827}, {0x0829, 0x082D}, {0x0859, 0x085B}, {0x0898, 0x089F}, {0x08CA, 0x08E1}, {0x08E3, 0x0903},
+    {0x093A, 0x093C}, {0x093E, 0x094F}, {0x0951, 0x0957}, {0x0962, 0x0963}, {0x0966, 0x096F}, {0x0981, 0x0983},
+    {0x09BC, 0x09BC}, {0x09BE, 0x09C4}, {0x09C7, 0x09C8}, {0x09CB, 0x09CD}, {0x09D7, 0x09D7}, {0x09E2, 0x09E3},
+    {0x09E6, 0x09EF}, {0x09FE, 0x09FE}, {0x0A01, 0x0A03}, {0x0A3C, 0x0A3C}, {0x0A3E, 0x0A42}, {0x0A47, 0x0A48},
+    {0x0A4B, 0x0A4D}, {0x0A51, 0x0A51}, {0x0A66, 0x0A71}, {0x0A75, 0x0A75}, {0x0A81, 0x0A83}, {0x0ABC, 0x0ABC},
+    {0x0ABE, 0x0AC5}, {0x0AC7, 0x0AC9}, {0x0ACB, 0x0ACD}, {0x0AE2, 0x0AE3}, {0x0AE6, 0x0AEF}, {0x0AFA, 0x0AFF},
+    {0x0B01, 0x0B03}, {0x0B3C, 0x0B3C}, {0x0B3E, 0x0B44}, {0x0B47, 0x0B48}, {0x0B4B, 0x0B4D}, {0x0B55, 0x0B57},
+    {0x0B62, 0x0B63}, {0x0B66, 0x0B6F}, {0x0B82, 0x0B82}, {0x0BBE, 0x0BC2}, {0x0BC6, 0x0BC8}, {0x0BCA, 0x0BCD},
+    {0x0BD7, 0x0BD7}, {0x0BE6, 0x0BEF}, {0x0C00, 0x0C04}, {0x0C3C, 0x0C3C}, {0x0C3E, 0x0C44}, {0x0C46, 0x0C48},
+    {0x0C4A, 0x0C4D}, {0x0C55, 0x0C56}, {0x0C62, 0x0C63}, {0x0C66, 0x0C6F}, {0x0C81, 0x0C83}, {0x0CBC, 0x0CBC},
+    {0x0CBE, 0x0CC4}, {0x0CC6, 0x0CC8}, {0x0CCA, 0x0CCD}, {0x0CD5, 0x0CD6}, {0x0CE2, 0x0CE3}, {0x0CE6, 0x0CEF},
+    {0x0D00, 0x0D03}, {0x0D3B, 0x0D3C}, {0x0D3E, 0x0D44}, {0x0D46, 0x0D48}, {0x0D4A, 0x0D4D}, {0x0D57, 0x0D57},
+    {0x0D62, 0x0D63}, {0x0D66, 0x0D6F}, {0x0D81, 0x0D83}, {0x0DCA, 0x0DCA}, {0x0DCF, 0x0DD4}, {0x0DD6, 0x0DD6},
+    {0x0DD8, 0x0DDF}, {0x0DE6, 0x0DEF}, {0x0DF2, 0x0DF3}, {0x0E31, 0x0E31}, {0x0E34, 0x0E3A}, {0x0E47, 0x0E4E},
+    {0x0E50, 0x0E59}, {0x0EB1, 0x0EB1}, {0x0EB4, 0x0EBC}, {0x0EC8, 0x0ECD}, {0x0ED0, 0x0ED9}, {0x0F18, 0x0F19},
+    {0x0F20, 0x0F29}, {0x0F35, 0x0F35}, {0x0F37, 0x0F37}, {0x0F39, 0x0F39}, {0x0F3E, 0x0F3F}, {0x0F71, 0x0F84},
+    {0x0F86, 0x0F87}, {0x0F8D, 0x0F97}, {0x0F99, 0x0FBC}, {0x0FC6, 0x0FC6}, {0x102B, 0x103E}, {0x1040, 0x1049},
+    {0x1056, 0x1059}, {0x105E, 0x1060}, {0x1062, 0x1064}, {0x1067, 0x106D}, {0x1071, 0x1074}, {0x1082, 0x108D},
+    {0x108F, 0x109D}, {0x135D, 0x135F}, {0x1712, 0x1715}, {0x1732, 0x1734}, {0x1752, 0x1753}, {0x1772, 0x1773},
+    {0x17B4, 0x17D3}, {0x17DD, 0x17DD}, {0x17E0, 0x17E9}, {0x180B, 0x180D}, {0x180F, 0x1819}, {0x1885, 0x1886},
+    {0x18A9, 0x18A9}, {0x1920, 0x192B}, {0x1930, 0x193B}, {0x1946, 0x194F}, {0x19D0, 0x19D9}, {0x1A17, 0x1A1B},
+    {0x1A55, 0x1A5E}, {0x1A60, 0x1A7C}, {0x1A7F, 0x1A89}, {0x1A90, 0x1A99}, {0x1AB0, 0x1ABD}, {0x1ABF, 0x1ACE},
+    {0x1B00, 0x1B04}, {0x1B34, 0x1B44}, {0x1B50, 0x1B59}, {0x1B6B, 0x1B73}, {0x1B80, 0x1B82}, {0x1BA1, 0x1BAD},
+    {0x1BB0, 0x1BB9}, {0x1BE6, 0x1BF3}, {0x1C24, 0x1C37}, {0x1C40, 0x1C49}, {0x1C50, 0x1C59}, {0x1CD0, 0x1CD2},
+    {0x1CD4, 0x1CE8}, {0x1CED, 0x1CED}, {0x1CF4, 0x1CF4}, {0x1CF7, 0x1CF9}, {0x1DC0, 0x1DFF}, {0x200C, 0x200D},
+    {0x203F, 0x2040}, {0x2054, 0x2054}, {0x20D0, 0x20DC}, {0x20E1, 0x20E1}, {0x20E5, 0x20F0}, {0x2CEF, 0x2CF1},
+    {0x2D7F, 0x2D7F}, {0x2DE0, 0x2DFF}, {0x302A, 0x302F}, {0x3099, 0x309A}, {0xA620, 0xA629}, {0xA66F, 0xA66F},
+    {0xA674, 0xA67D}, {0xA69E, 0xA69F}, {0xA6F0, 0xA6F1}, {0xA802, 0xA802}, {0xA806, 0xA806}, {0xA80B, 0xA80B},
+    {0xA823, 0xA827}, {0xA82C, 0xA82C}, {0xA880, 0xA881}, {0xA8B4, 0xA8C5}, {0xA8D0, 0xA8D9}, {0xA8E0, 0xA8F1},
+    {0xA8FF, 0xA909}, {0xA926, 0xA92D}, {0xA947, 0xA953}, {0xA980, 0xA983}, {0xA9B3, 0xA9C0}, {0xA9D0, 0xA9D9},
+    {0xA9E5, 0xA9E5}, {0xA9F0, 0xA9F9}, {0xAA29, 0xAA36}, {0xAA43, 0xAA43}, {0xAA4C, 0xAA4D}, {0xAA50, 0xAA59},
+    {0xAA7B, 0xAA7D}, {0xAAB0, 0xAAB0}, {0xAAB2, 0xAAB4}, {0xAAB7, 0xAAB8}, {0xAABE, 0xAABF}, {0xAAC1, 0xAAC1},
+    {0xAAEB, 0xAAEF}, {0xAAF5, 0xAAF6}, {0xABE3, 0xABEA}, {0xABEC, 0xABED}, {0xABF0, 0xABF9}, {0xFB1E, 0xFB1E},
+    {0xFE00, 0xFE0F}, {0xFE20, 0xFE2F}, {0xFE33, 0xFE34}, {0xFE4D, 0xFE4F}, {0xFF10, 0xFF19}, {0xFF3F, 0xFF3F},
+    {0x101FD, 0x101FD}, {0x102E0, 0x102E0}, {0x10376, 0x1037A}, {0x104A0, 0x104A9}, {0x10A01, 0x10A03},
+    {0x10A05, 0x10A06}, {0x10A0C, 0x10A0F}, {0x10A38, 0x10A3A}, {0x10A3F, 0x10A3F}, {0x10AE5, 0x10AE6},
+    {0x10D24, 0x10D27}, {0x10D30, 0x10D39}, {0x10EAB, 0x10EAC}, {0x10F46, 0x10F50}, {0x10F82, 0x10F85},
+    {0x11000, 0x11002}, {0x11038, 0x11046}, {0x11066, 0x11070}, {0x11073, 0x11074}, {0x1107F, 0x11082},
+    {0x110B0, 0x110BA}, {0x110C2, 0x110C2}, {0x110F0, 0x110F9}, {0x11100, 0x11102}, {0x11127, 0x11134},
+    {0x11136, 0x1113F}, {0x11145, 0x11146}, {0x11173, 0x11173}, {0x11180, 0x11182}, {0x111B3, 0x111C0},
+    {0x111C9, 0x111CC}, {0x111CE, 0x111D9}, {0x1122C, 0x11237}, {0x1123E, 0x1123E}, {0x112DF, 0x112EA},
+    {0x112F0, 0x112F9}, {0x11300, 0x11303}, {0x1133B, 0x1133C}, {0x1133E, 0x11344}, {0x11347, 0x11348},
+    {0x1134B, 0x1134D}, {0x11357, 0x11357}, {0x11362, 0x11363}, {0x11366, 0x1136C}, {0x11370, 0x11374},
+    {0x11435, 0x11446}, {0x11450, 0x11459}, {0x1145E, 0x1145E}, {0x114B0, 0x114C3}, {0x114D0, 0x114D9},
+    {0x115AF, 0x115B5}, {0x115B8, 0x115C0}, {0x115DC, 0x115DD}, {0x11630, 0x11640}, {0x11650, 0x11659},
+    {0x116AB, 0x116B7}, {0x116C0, 0x116C9}, {0x1171D, 0x1172B}, {0x11730, 0x11739}, {0x1182C, 0x1183A},
+    {0x118E0, 0x118E9}, {0x11930, 0x11935}, {0x11937, 0x11938}, {0x1193B, 0x1193E}, {0x11940, 0x11940},
+    {0x11942, 0x11943}, {0x11950, 0x11959}, {0x119D1, 0x119D7}, {0x119DA, 0x119E0}, {0x119E4, 0x119E4},
+    {0x11A01, 0x11A0A}, {0x11A33, 0x11A39}, {0x11A3B, 0x11A3E}, {0x11A47, 0x11A47}, {0x11A51, 0x11A5B},
+    {0x11A8A, 0x11A99}, {0x11C2F, 0x11C36}, {0x11C38, 0x11C3F}, {0x11C50, 0x11C59}, {0x11C92, 0x11CA7},
+    {0x11CA9, 0x11CB6}, {0x11D31, 0x11D36}, {0x11D3A, 0x11D3A}, {0x11D3C, 0x11D3D}, {0x11D3F, 0x11D45},
+    {0x11D47, 0x11D47}, {0x11D50, 0x11D59}, {0x11D8A, 0x11D8E}, {0x11D90, 0x11D91}, {0x11D93, 0x11D97},
+    {0x11DA0, 0x11DA9}, {0x11EF3, 0x11EF6}, {0x16A60, 0x16A69}, {0x16AC0, 0x16AC9}, {0x16AF0, 0x16AF4},
+    {0x16B30, 0x16B36}, {0x16B50, 0x16B59}, {0x16F4F, 0x16F4F}, {0x16F51, 0x16F87}, {0x16F8F, 0x16F92},
+    {0x16FE4, 0x16FE4}, {0x16FF0, 0x16FF1}, {0x1BC9D, 0x1BC9E}, {0x1CF00, 0x1CF2D}, {0x1CF30, 0x1CF46},
+    {0x1D165, 0x1D169}, {0x1D16D, 0x1D172}, {0x1D17B, 0x1D182}, {0x1D185, 0x1D18B}, {0x1D1AA, 0x1D1AD},
+    {0x1D242, 0x1D244}, {0x1D7CE, 0x1D7FF}, {0x1DA00, 0x1DA36}, {0x1DA3B, 0x1DA6C}, {0x1DA75, 0x1DA75},
+    {0x1DA84, 0x1DA84}, {0x1DA9B, 0x1DA9F}, {0x1DAA1, 0x1DAAF}, {0x1E000, 0x1E006}, {0x1E008, 0x1E018},
+    {0x1E01B, 0x1E021}, {0x1E023, 0x1E024}, {0x1E026, 0x1E02A}, {0x1E130, 0x1E136}, {0x1E140, 0x1E149},
+    {0x1E2AE, 0x1E2AE}, {0x1E2EC, 0x1E2F9}, {0x1E8D0, 0x1E8D6}, {0x1E944, 0x1E94A}, {0x1E950, 0x1E959},
+    {0x1FBF0, 0x1FBF9}, {0xE0100, 0xE01EF},
+};
+
+bool rune_in_ranges(uint32_t rune, const Rune_Range *ranges, size_t count)
+{
+    size_t low = 0;
+    size_t high = count;
+    while (low < high) {
+        size_t middle = low + (high - low) / 2;
+        if (rune < ranges[middle].first) high = middle;
+        else if (rune > ranges[middle].last) low = middle + 1;
+        else return true;
+    }
+    return false;
+}
+
 Arena *arena_create(size_t size)
 {
     Arena *arena = malloc(sizeof *arena + size);
@@ -175,6 +662,11 @@ void arena_destroy(Arena *arena)
     free(arena);
 }
 
+void arena_reset(Arena *arena)
+{
+    for (; arena != NULL; arena = arena->next) arena->used = 0;
+}
+
 void *arena_allocate_aligned(Arena *arena, size_t size, size_t alignment)
 {
     size_t offset = (alignment - (arena->used & (alignment - 1))) & (alignment - 1);
@@ -208,6 +700,7 @@ char *arena_duplicate_string(Arena *arena, const char *from, size_t length)
 const char *lexer_status_name(Lexer_Status status)
 {
     switch (status) {
+    case Lexer_Status__Invalid_Utf8: return "Invalid_Utf8";
     case Lexer_Status__Unclosed_String: return "Unclosed_String";
     case Lexer_Status__Invalid_Number: return "Invalid_Number";
     case Lexer_Status__Invalid_String: return "Invalid_String";
@@ -253,6 +746,7 @@ const char *token_kind_name(Token_Kind kind)
     case Token_Kind__Else: return "Else";
     case Token_Kind__End: return "End";
     case Token_Kind__Exists: return "Exists";
+    case Token_Kind__Filter: return "Filter";
     case Token_Kind__Foreign: return "Foreign";
     case Token_Kind__From: return "From";
     case Token_Kind__Full: return "Full";
@@ -316,6 +810,104 @@ const char *token_kind_name(Token_Kind kind)
     }
 }
 
+/* Canonical SQL spelling of keywords and symbols. Tokens carrying a literal have none. */
+const char *token_kind_text(Token_Kind kind)
+{
+    switch (kind) {
+    case Token_Kind__None:
+    case Token_Kind__Identifier:
+    case Token_Kind__Literal_Number:
+    case Token_Kind__Literal_Text: return NULL;
+
+    case Token_Kind__All: return "ALL";
+    case Token_Kind__Alter: return "ALTER";
+    case Token_Kind__And: return "AND";
+    case Token_Kind__Any: return "ANY";
+    case Token_Kind__As: return "AS";
+    case Token_Kind__Asc: return "ASC";
+    case Token_Kind__Avg: return "AVG";
+    case Token_Kind__Between: return "BETWEEN";
+    case Token_Kind__By: return "BY";
+    case Token_Kind__Case: return "CASE";
+    case Token_Kind__Check: return "CHECK";
+    case Token_Kind__Constraint: return "CONSTRAINT";
+    case Token_Kind__Count: return "COUNT";
+    case Token_Kind__Create: return "CREATE";
+    case Token_Kind__Current_Date: return "CURRENT_DATE";
+    case Token_Kind__Current_Time: return "CURRENT_TIME";
+    case Token_Kind__Current_Timestamp: return "CURRENT_TIMESTAMP";
+    case Token_Kind__Default: return "DEFAULT";
+    case Token_Kind__Delete: return "DELETE";
+    case Token_Kind__Desc: return "DESC";
+    case Token_Kind__Distinct: return "DISTINCT";
+    case Token_Kind__Drop: return "DROP";
+    case Token_Kind__Else: return "ELSE";
+    case Token_Kind__End: return "END";
+    case Token_Kind__Exists: return "EXISTS";
+    case Token_Kind__Filter: return "FILTER";
+    case Token_Kind__Foreign: return "FOREIGN";
+    case Token_Kind__From: return "FROM";
+    case Token_Kind__Full: return "FULL";
+    case Token_Kind__Group: return "GROUP";
+    case Token_Kind__Having: return "HAVING";
+    case Token_Kind__In: return "IN";
+    case Token_Kind__Index: return "INDEX";
+    case Token_Kind__Inner: return "INNER";
+    case Token_Kind__Insert: return "INSERT";
+    case Token_Kind__Is: return "IS";
+    case Token_Kind__Join: return "JOIN";
+    case Token_Kind__Key: return "KEY";
+    case Token_Kind__Left: return "LEFT";
+    case Token_Kind__Like: return "LIKE";
+    case Token_Kind__Limit: return "LIMIT";
+    case Token_Kind__Max: return "MAX";
+    case Token_Kind__Min: return "MIN";
+    case Token_Kind__Not: return "NOT";
+    case Token_Kind__Null: return "NULL";
+    case Token_Kind__Offset: return "OFFSET";
+    case Token_Kind__On: return "ON";
+    case Token_Kind__Or: return "OR";
+    case Token_Kind__Order: return "ORDER";
+    case Token_Kind__Outer: return "OUTER";
+    case Token_Kind__Primary: return "PRIMARY";
+    case Token_Kind__References: return "REFERENCES";
+    case Token_Kind__Returning: return "RETURNING";
+    case Token_Kind__Right: return "RIGHT";
+    case Token_Kind__Select: return "SELECT";
+    case Token_Kind__Sequence: return "SEQUENCE";
+    case Token_Kind__Sum: return "SUM";
+    case Token_Kind__Table: return "TABLE";
+    case Token_Kind__Then: return "THEN";
+    case Token_Kind__Trigger: return "TRIGGER";
+    case Token_Kind__Union: return "UNION";
+    case Token_Kind__Unique: return "UNIQUE";
+    case Token_Kind__Update: return "UPDATE";
+    case Token_Kind__Values: return "VALUES";
+    case Token_Kind__View: return "VIEW";
+    case Token_Kind__When: return "WHEN";
+    case Token_Kind__Where: return "WHERE";
+
+    case Token_Kind__Asterisk: return "*";
+    case Token_Kind__Comma: return ",";
+    case Token_Kind__Dot: return ".";
+    case Token_Kind__Equals: return "=";
+    case Token_Kind__Greater: return ">";
+    case Token_Kind__Greater_Equals: return ">=";
+    case Token_Kind__Lesser: return "<";
+    case Token_Kind__Lesser_Equals: return "<=";
+    case Token_Kind__Minus: return "-";
+    case Token_Kind__Not_Equals: return "<>";
+    case Token_Kind__Parenthesis_Close: return ")";
+    case Token_Kind__Parenthesis_Open: return "(";
+    case Token_Kind__Double_Pipe: return "||";
+    case Token_Kind__Plus: return "+";
+    case Token_Kind__Semicolon: return ";";
+    case Token_Kind__Slash: return "/";
+
+    default: UNREACHABLE();
+    }
+}
+
 void print_token(const Token *token)
 {
     const char *name = token_kind_name(token->kind);
@@ -333,12 +925,17 @@ void lexer_setup(Lexer *lexer, const char *source, size_t source_length)
     lexer->end = source + source_length;
     lexer->head = lexer->begin;
     lexer->line_start = lexer->begin;
+    lexer->line_scan = lexer->begin;
+    lexer->validated = lexer->begin;
     lexer->line = 0;
     lexer->tokens_used = 0;
+    lexer->next_token = NULL;
     lexer->tokens_allocated = 64;
     lexer->tokens = malloc(lexer->tokens_allocated * sizeof lexer->tokens[0]);
     assert(lexer->tokens != NULL);
     lexer->strings = arena_create(64);
+    lexer->batch_continues_statement = false;
+    lexer->batch_cuts_statement = false;
 }
 
 void lexer_teardown(Lexer *lexer)
@@ -350,7 +947,10 @@ void lexer_teardown(Lexer *lexer)
         lexer->tokens = NULL;
     }
 
-    if (lexer->strings != NULL) arena_destroy(lexer->strings);
+    if (lexer->strings != NULL) {
+        arena_destroy(lexer->strings);
+        lexer->strings = NULL;
+    }
 }
 
 Token *lexer_next_token(Lexer *lexer, Token_Kind kind)
@@ -365,6 +965,15 @@ Token *lexer_next_token(Lexer *lexer, Token_Kind kind)
         lexer->next_token = &lexer->tokens[lexer->tokens_used++];
     }
 
+    /* Catch up on newlines skipped since the last token, including those inside comments and strings. */
+    const char *newline;
+    while ((newline = memchr(lexer->line_scan, '\n', lexer->head - lexer->line_scan)) != NULL) {
+        ++lexer->line;
+        lexer->line_start = newline + 1;
+        lexer->line_scan = newline + 1;
+    }
+    lexer->line_scan = lexer->head;
+
     lexer->next_token->kind = kind;
     lexer->next_token->position = lexer->head - lexer->begin;
     lexer->next_token->line = lexer->line;
@@ -386,24 +995,78 @@ void lexer_accept_next_token(Lexer *lexer, Token_Kind kind)
     lexer_accept_token(lexer);
 }
 
+void lexer_discard_token(Lexer *lexer)
+{
+    if (lexer->next_token == NULL) return;
+
+    /* A pending token is always the last one reserved. */
+    --lexer->tokens_used;
+    lexer->next_token = NULL;
+}
+
+/* Drops every token produced so far, along with their literals, once the caller is done with them. */
+void lexer_flush_tokens(Lexer *lexer)
+{
+    lexer->tokens_used = 0;
+    lexer->next_token = NULL;
+    arena_reset(lexer->strings);
+}
+
 bool lexer_is_end(Lexer *lexer)
 {
     return lexer->head >= lexer->end;
 }
 
+#define LEXER_VALIDATION_CHUNK (64 * 1024)
+
+/* Validates the input as UTF-8 a chunk at a time ahead of the head, so validation streams along with lexing
+ * instead of taking a pass over the whole input first. */
+bool lexer_validate(Lexer *lexer, const char *until)
+{
+    while (lexer->validated < until && lexer->validated < lexer->end) {
+        size_t remaining = lexer->end - lexer->validated;
+        size_t chunk = remaining < LEXER_VALIDATION_CHUNK ? remaining : LEXER_VALIDATION_CHUNK;
+        size_t valid = utf8_valid_prefix(lexer->validated, chunk);
+        lexer->validated += valid;
+        if (valid == chunk) continue;
+
+        /* The chunk may have cut a sequence in two. */
+        size_t size = utf8_sequence_size((const uint8_t *)lexer->validated, (const uint8_t *)lexer->end);
+        if (size == 0) return false;
+        lexer->validated += size;
+    }
+
+    return true;
+}
+
 void lexer_skip_whitespace(Lexer *lexer)
 {
-    while (!lexer_is_end(lexer) && isspace(lexer->head[0])) ++lexer->head;
+    while (!lexer_is_end(lexer) && is_space_ascii(lexer->head[0])) ++lexer->head;
+}
+
+/* Returns the size of the rune at the head, or 0 if it is not valid UTF-8. */
+size_t lexer_peek_rune(Lexer *lexer, uint32_t *rune)
+{
+    if ((uint8_t)lexer->head[0] < 0x80) { /* ASCII fast path. */
+        *rune = (uint8_t)lexer->head[0];
+        return 1;
+    }
+
+    if (!lexer_validate(lexer, lexer->head + 4)) return 0;
+    return utf8_decode(lexer->head, rune);
 }
 
-bool is_identifier_head(char rune)
+bool is_identifier_head(uint32_t rune)
 {
-    return isalpha(rune) || rune == '_';
+    if (rune < 0x80) return is_alpha_ascii((char)rune) || rune == '_';
+    return rune_in_ranges(rune, identifier_start_runes, sizeof identifier_start_runes / sizeof identifier_start_runes[0]);
 }
 
-bool is_identifier_tail(char rune)
+bool is_identifier_tail(uint32_t rune)
 {
-    return isalnum(rune) || rune == '_';
+    if (rune < 0x80) return is_alpha_ascii((char)rune) || is_digit_ascii((char)rune) || rune == '_';
+    return is_identifier_head(rune)
+        || rune_in_ranges(rune, identifier_extend_runes, sizeof identifier_extend_runes / sizeof identifier_extend_runes[0]);
 }
 
 Lexer_Status lexer_chop_string(Lexer *lexer, char delimiter)
@@ -414,21 +1077,32 @@ Lexer_Status lexer_chop_string(Lexer *lexer, char delimiter)
     ++lexer->head;
     while (!lexer_is_end(lexer)) {
         if (delimiter_found) { /* Handle escaping. */
+            if (lexer->head[0] != delimiter) return Lexer_Status__Token_Found;
             delimiter_found = false;
-            if (lexer->head[0] != delimiter) break;
         } else if (lexer->head[0] == delimiter) delimiter_found = true;
 
         ++lexer->head;
     }
 
-    if (delimiter_found) return Lexer_Status__Invalid_String;
-    return Lexer_Status__Token_Found;
+    /* The input ended right after the closing delimiter, or inside the string. */
+    if (delimiter_found) return Lexer_Status__Token_Found;
+    return Lexer_Status__Unclosed_String;
 }
 
 Lexer_Status lexer_chop_simple_identifier(Lexer *lexer)
 {
-    if (!is_identifier_head(lexer->head[0])) return Lexer_Status__Ok;
-    do ++lexer->head; while (!lexer_is_end(lexer) && is_identifier_tail(lexer->head[0]));
+    uint32_t rune;
+    size_t size = lexer_peek_rune(lexer, &rune);
+    if (size == 0) return Lexer_Status__Invalid_Utf8;
+    if (!is_identifier_head(rune)) return Lexer_Status__Ok;
+
+    do {
+        lexer->head += size;
+        if (lexer_is_end(lexer)) break;
+        size = lexer_peek_rune(lexer, &rune);
+        if (size == 0) return Lexer_Status__Invalid_Utf8;
+    } while (is_identifier_tail(rune));
+
     return Lexer_Status__Token_Found;
 }
 
@@ -495,6 +1169,7 @@ Token_Kind lexer_test_keyword(const char *name, size_t length)
         if (strings_equal_caseless("create", name, 6)) return Token_Kind__Create;
         if (strings_equal_caseless("delete", name, 6)) return Token_Kind__Delete;
         if (strings_equal_caseless("exists", name, 6)) return Token_Kind__Exists;
+        if (strings_equal_caseless("filter", name, 6)) return Token_Kind__Filter;
         if (strings_equal_caseless("having", name, 6)) return Token_Kind__Having;
         if (strings_equal_caseless("insert", name, 6)) return Token_Kind__Insert;
         if (strings_equal_caseless("offset", name, 6)) return Token_Kind__Offset;
@@ -534,48 +1209,57 @@ Token_Kind lexer_test_keyword(const char *name, size_t length)
     return Token_Kind__None;
 }
 
-Lexer_Status lexer_tokenize_keyword(Lexer *lexer, const char *name, size_t length)
-{
-    Token_Kind kind = lexer_test_keyword(name, length);
-    if (kind == Token_Kind__None) return Lexer_Status__Ok;
-    
-    lexer_accept_next_token(lexer, kind);
-    return Lexer_Status__Token_Found;
-}
-
 Lexer_Status lexer_tokenize_identifier(Lexer *lexer)
 {
+    Token *token = lexer_next_token(lexer, Token_Kind__None);
     const char *literal = lexer->head;
-    size_t literal_length = 0;
 
     Lexer_Status status;
     if ((status = lexer_chop_simple_identifier(lexer)) != Lexer_Status__Ok) {
         if (status != Lexer_Status__Token_Found) return status;
-        literal_length = lexer->head - literal;
-        
-        if ((status = lexer_tokenize_keyword(lexer, literal, literal_length)) != Lexer_Status__Ok) return status;
+        token->literal_length = lexer->head - literal;
+
+        Token_Kind keyword = lexer_test_keyword(literal, token->literal_length);
+        if (keyword != Token_Kind__None) {
+            token->kind = keyword;
+            token->literal_length = 0;
+            lexer_accept_token(lexer);
+            return Lexer_Status__Token_Found;
+        }
     } else if ((status = lexer_chop_quoted_identifier(lexer)) != Lexer_Status__Ok) {
         if (status != Lexer_Status__Token_Found) return status;
         ++literal; /* Exclude opening quote from literal. */
-        literal_length = lexer->head - literal - 1;
+        token->literal_length = lexer->head - literal - 1;
     } else return Lexer_Status__Ok;
 
-    Token *token = lexer_next_token(lexer, Token_Kind__Identifier);
-    token->literal_length = literal_length;
+    token->kind = Token_Kind__Identifier;
     token->literal = arena_duplicate_string(lexer->strings, literal, token->literal_length);
     lexer_accept_token(lexer);
     return Lexer_Status__Token_Found;
 }
 
+/* Chops digits[.digits][e[+-]digits] or .digits[e[+-]digits], never reading past the end of the source. */
 Lexer_Status lexer_chop_literal_number(Lexer *lexer)
 {
-    if (!(isdigit(lexer->head[0]) || (lexer->head[0] == '.' && lexer->head != lexer->end && isdigit(lexer->head[1])))) return Lexer_Status__Ok;
+    const char *head = lexer->head;
+    const char *end = lexer->end;
+    if (!(is_digit_ascii(head[0]) || (head[0] == '.' && head + 1 != end && is_digit_ascii(head[1])))) return Lexer_Status__Ok;
+
+    while (head < end && is_digit_ascii(head[0])) ++head;
+    if (head < end && head[0] == '.') {
+        do ++head; while (head < end && is_digit_ascii(head[0]));
+    }
 
-    char *end;
-    UNUSED(strtod(lexer->head, &end));
+    if (head < end && (head[0] == 'e' || head[0] == 'E')) {
+        const char *exponent = head + 1;
+        if (exponent < end && (exponent[0] == '+' || exponent[0] == '-')) ++exponent;
+        if (exponent < end && is_digit_ascii(exponent[0])) {
+            head = exponent;
+            while (head < end && is_digit_ascii(head[0])) ++head;
+        }
+    }
 
-    if (lexer->head == end) return Lexer_Status__Invalid_Number;
-    lexer->head = end;
+    lexer->head = head;
     return Lexer_Status__Token_Found;
 }
 
@@ -609,6 +1293,7 @@ Lexer_Status lexer_tokenize_literal(Lexer *lexer)
 Lexer_Status lexer_tokenize_symbol(Lexer *lexer)
 {
     Token_Kind kind = Token_Kind__None;
+    size_t length = 1;
 
     switch (lexer->head[0]) {
     case '*': kind = Token_Kind__Asterisk; break;
@@ -623,24 +1308,24 @@ Lexer_Status lexer_tokenize_symbol(Lexer *lexer)
 
     case '=': {
         kind = Token_Kind__Equals;
-        if ((lexer->head + 1) != lexer->end && lexer->head[1] == '=') ++lexer->head;
+        if ((lexer->head + 1) != lexer->end && lexer->head[1] == '=') length = 2;
     } break;
 
     case '>': {
         if ((lexer->head + 1) != lexer->end && lexer->head[1] == '=') {
             kind = Token_Kind__Greater_Equals;
-            ++lexer->head;
+            length = 2;
         } else kind = Token_Kind__Greater;
     } break;
 
     case '<': {
-        if ((lexer->head + 1) == lexer->end) {
+        if ((lexer->head + 1) != lexer->end) {
             if (lexer->head[1] == '=') {
                 kind = Token_Kind__Lesser_Equals;
-                ++lexer->head;
+                length = 2;
             } else if (lexer->head[1] == '>') {
                 kind = Token_Kind__Not_Equals;
-                ++lexer->head;
+                length = 2;
             } else kind = Token_Kind__Lesser;
         } else kind = Token_Kind__Lesser;
     } break;
@@ -649,20 +1334,20 @@ Lexer_Status lexer_tokenize_symbol(Lexer *lexer)
         if (lexer->head + 1 == lexer->end || lexer->head[1] != '=') return Lexer_Status__Unexpected_Character;
 
         kind = Token_Kind__Not_Equals;
-        ++lexer->head;
+        length = 2;
     } break;
 
     case '|': {
         if (lexer->head + 1 == lexer->end || lexer->head[1] != '|') return Lexer_Status__Unexpected_Character;
 
         kind = Token_Kind__Double_Pipe;
-        ++lexer->head;
+        length = 2;
     } break;
     }
 
     if (kind != Token_Kind__None) {
-        lexer_accept_next_token(lexer, kind);
-        ++lexer->head;
+        lexer_accept_next_token(lexer, kind); /* Before advancing, so the token starts at the symbol. */
+        lexer->head += length;
         return Lexer_Status__Token_Found;
     }
 
@@ -712,58 +1397,1575 @@ Lexer_Status lexer_tokenize_next(Lexer *lexer)
     return Lexer_Status__Unexpected_Character;
 }
 
-Lexer_Status lexer_tokenize(Lexer *lexer)
+/* Tokenizes until at least batch_size tokens are available and the last one ends a statement, or until
+ * batch_limit tokens are available even if that cuts a statement, so memory stays bounded. Returns Token_Found
+ * while input remains. */
+Lexer_Status lexer_tokenize_batch(Lexer *lexer, size_t batch_size, size_t batch_limit)
 {
+    lexer->batch_continues_statement = lexer->batch_cuts_statement;
+    lexer->batch_cuts_statement = false;
+
     while (lexer->head < lexer->end) {
         lexer_skip_whitespace(lexer);
 
-        if (lexer_is_end(lexer)) return Lexer_Status__Ok;
+        if (lexer_is_end(lexer)) break;
+        if (!lexer_validate(lexer, lexer->head + 1)) return Lexer_Status__Invalid_Utf8;
 
         Lexer_Status status = lexer_tokenize_next(lexer);
         if (status < Lexer_Status__Ok) return status;
+
+        if (lexer->tokens_used < batch_size || lexer->next_token != NULL) continue;
+
+        bool statement_ended = lexer->tokens[lexer->tokens_used - 1].kind == Token_Kind__Semicolon;
+        if (statement_ended || lexer->tokens_used >= batch_limit) {
+            lexer_skip_whitespace(lexer);
+            if (lexer_is_end(lexer)) break;
+
+            /* Strings and comments are scanned without decoding, so they may have run past the validated input. */
+            if (!lexer_validate(lexer, lexer->head)) return Lexer_Status__Invalid_Utf8;
+            lexer->batch_cuts_statement = !statement_ended;
+            return Lexer_Status__Token_Found;
+        }
     }
 
+    if (!lexer_validate(lexer, lexer->end)) return Lexer_Status__Invalid_Utf8;
+    lexer_discard_token(lexer);
     return Lexer_Status__Ok;
 }
 
-int main(int argc, char **argv)
+Lexer_Status lexer_tokenize(Lexer *lexer)
 {
-    UNUSED(argc, argv);
+    return lexer_tokenize_batch(lexer, SIZE_MAX, SIZE_MAX);
+}
 
-    const char *input =
-        "-- List players victories and scores.\n"
-        "SELECT\n"
-        "    player.id AS \"Player ID\", 1000 420.69 .55435 .545aasd \n"
-        "    player.nick_name AS \"Nickname\",\n"
-        "    AGE(CURRENT_TIMESTAMP, player.created_at) AS \"\"\"Account\"\" age\",\n"
-        "    SUM(match.score) AS \"Total Score\",\n"
-        "    COUNT(CASE WHEN match.state = 'won' THEN 1 END) AS \"Victories\"\n"
-        "FROM game.player\n"
-        "LEFT JOIN game.player_match match\n"
-        "    ON match.player_id = player.id\n"
-        "WHERE player.status != 'inac''tive'\n"
-        "    AND player.rank >= 2000\n"
-        "    /*AND player.rank BETWEEN 2000 AND 3000*/\n"
-        "    AND player.deleted_at IS NULL\n"
-        "GROUP BY player.id\n";
+void token_batch_teardown(Token_Batch *batch)
+{
+    if (batch == NULL) return;
 
-    Lexer lexer = {0};
-    lexer_setup(&lexer, input, strlen(input));
+    if (batch->tokens != NULL) {
+        free(batch->tokens);
+        batch->tokens = NULL;
+    }
 
-    Lexer_Status status = lexer_tokenize(&lexer);
-    if (status != Lexer_Status__Ok) {
-        printf("Failed to tokenize: %s\n", lexer_status_name(status));
-        return EXIT_FAILURE;
+    if (batch->strings != NULL) {
+        arena_destroy(batch->strings);
+        batch->strings = NULL;
+    }
+}
+
+/* Hands the tokens of the last batch over to batch, taking its previous buffers in exchange for the next one. */
+void lexer_hand_over(Lexer *lexer, Token_Batch *batch, Lexer_Status status)
+{
+    Token *tokens = batch->tokens;
+    size_t tokens_allocated = batch->tokens_allocated;
+    Arena *strings = batch->strings;
+
+    batch->tokens = lexer->tokens;
+    batch->tokens_used = lexer->tokens_used;
+    batch->tokens_allocated = lexer->tokens_allocated;
+    batch->strings = lexer->strings;
+    batch->continues_statement = lexer->batch_continues_statement;
+    batch->cuts_statement = lexer->batch_cuts_statement;
+    batch->status = status;
+
+    lexer->tokens = tokens;
+    lexer->tokens_allocated = tokens_allocated;
+    lexer->strings = strings != NULL ? strings : arena_create(64);
+    lexer_flush_tokens(lexer);
+}
+
+void batch_ring_setup(Batch_Ring *ring)
+{
+    for (size_t i = 0; i < BATCH_RING_CAPACITY; ++i) ring->slots[i] = (Token_Batch){0};
+    atomic_init(&ring->head, 0);
+    atomic_init(&ring->tail, 0);
+    atomic_init(&ring->producer_parked, false);
+    atomic_init(&ring->consumer_parked, false);
+    pthread_mutex_init(&ring->lock, NULL);
+    pthread_cond_init(&ring->moved, NULL);
+}
+
+void batch_ring_teardown(Batch_Ring *ring)
+{
+    for (size_t i = 0; i < BATCH_RING_CAPACITY; ++i) token_batch_teardown(&ring->slots[i]);
+    pthread_mutex_destroy(&ring->lock);
+    pthread_cond_destroy(&ring->moved);
+}
+
+/* Both sides store their progress or parked flag before loading the other's, all sequentially consistent, so either
+ * a parking side sees the progress or the progressing side sees it parked and wakes it. */
+bool batch_ring_has_free(Batch_Ring *ring, size_t tail)
+{
+    return tail - atomic_load(&ring->head) != BATCH_RING_CAPACITY;
+}
+
+bool batch_ring_has_full(Batch_Ring *ring, size_t head)
+{
+    return atomic_load(&ring->tail) != head;
+}
+
+void batch_ring_wake(Batch_Ring *ring)
+{
+    pthread_mutex_lock(&ring->lock);
+    pthread_cond_broadcast(&ring->moved);
+    pthread_mutex_unlock(&ring->lock);
+}
+
+/* Waits for a free slot to produce into, which is how a slow consumer holds the producer back. */
+Token_Batch *batch_ring_acquire_free(Batch_Ring *ring)
+{
+    size_t tail = atomic_load_explicit(&ring->tail, memory_order_relaxed);
+
+    for (size_t spin = 0; !batch_ring_has_free(ring, tail); ++spin) {
+        if (spin < BATCH_RING_SPINS) {
+            sched_yield();
+            continue;
+        }
+
+        pthread_mutex_lock(&ring->lock);
+        atomic_store(&ring->producer_parked, true);
+        while (!batch_ring_has_free(ring, tail)) pthread_cond_wait(&ring->moved, &ring->lock);
+        atomic_store(&ring->producer_parked, false);
+        pthread_mutex_unlock(&ring->lock);
+    }
+
+    return &ring->slots[tail % BATCH_RING_CAPACITY];
+}
+
+void batch_ring_publish(Batch_Ring *ring)
+{
+    size_t tail = atomic_load_explicit(&ring->tail, memory_order_relaxed);
+    atomic_store(&ring->tail, tail + 1);
+    if (atomic_load(&ring->consumer_parked)) batch_ring_wake(ring);
+}
+
+/* Waits for the oldest produced slot. */
+Token_Batch *batch_ring_acquire_full(Batch_Ring *ring)
+{
+    size_t head = atomic_load_explicit(&ring->head, memory_order_relaxed);
+
+    for (size_t spin = 0; !batch_ring_has_full(ring, head); ++spin) {
+        if (spin < BATCH_RING_SPINS) {
+            sched_yield();
+            continue;
+        }
+
+        pthread_mutex_lock(&ring->lock);
+        atomic_store(&ring->consumer_parked, true);
+        while (!batch_ring_has_full(ring, head)) pthread_cond_wait(&ring->moved, &ring->lock);
+        atomic_store(&ring->consumer_parked, false);
+        pthread_mutex_unlock(&ring->lock);
+    }
+
+    return &ring->slots[head % BATCH_RING_CAPACITY];
+}
+
+void batch_ring_release(Batch_Ring *ring)
+{
+    size_t head = atomic_load_explicit(&ring->head, memory_order_relaxed);
+    atomic_store(&ring->head, head + 1);
+    if (atomic_load(&ring->producer_parked)) batch_ring_wake(ring);
+}
+
+const char *dialect_name(Dialect dialect)
+{
+    switch (dialect) {
+    case Dialect__Postgres: return "Postgres";
+    case Dialect__Oracle: return "Oracle";
+    case Dialect__MySql: return "MySql";
+    default: UNREACHABLE();
+    }
+}
+
+bool dialect_parse(const char *name, Dialect *dialect)
+{
+    size_t length = strlen(name);
+    if ((length == 8 && strings_equal_caseless("postgres", name, 8))
+        || (length == 10 && strings_equal_caseless("postgresql", name, 10))) *dialect = Dialect__Postgres;
+    else if (length == 6 && strings_equal_caseless("oracle", name, 6)) *dialect = Dialect__Oracle;
+    else if (length == 5 && strings_equal_caseless("mysql", name, 5)) *dialect = Dialect__MySql;
+    else return false;
+    return true;
+}
+
+const char *rewrite_rule_name(Rewrite_Rule rule)
+{
+    switch (rule) {
+    case Rewrite_Rule__Fold_Constants: return "Fold_Constants";
+    case Rewrite_Rule__Count_Case_To_Filter: return "Count_Case_To_Filter";
+    case Rewrite_Rule__Drop_Grouped_Distinct: return "Drop_Grouped_Distinct";
+    default: UNREACHABLE();
+    }
+}
+
+bool token_is_quoted(const Lexer *lexer, const Token *token)
+{
+    return token->kind == Token_Kind__Identifier && lexer->begin[token->position] == '"';
+}
+
+bool tokens_equal(const Lexer *lexer, const Token *first, const Token *second)
+{
+    if (first->kind != second->kind || first->literal_length != second->literal_length) return false;
+    if (first->literal_length == 0) return true;
+
+    if (first->kind == Token_Kind__Identifier) {
+        bool quoted = token_is_quoted(lexer, first);
+        if (quoted != token_is_quoted(lexer, second)) return false;
+        if (!quoted) return strings_equal_caseless(first->literal, second->literal, first->literal_length);
+    }
+
+    return memcmp(first->literal, second->literal, first->literal_length) == 0;
+}
+
+/* Turns token into a new token of kind, placed at the source location of origin. */
+void token_rewrite(Token *token, Token_Kind kind, const Token *origin)
+{
+    *token = *origin;
+    token->kind = kind;
+    token->literal = NULL;
+    token->literal_length = 0;
+}
+
+bool rewrite_integer_value(const Token *token, int64_t *value)
+{
+    if (token->kind != Token_Kind__Literal_Number) return false;
+
+    /* Folded results may be negative; source literals never are. */
+    size_t i = token->literal[0] == '-' ? 1 : 0;
+    size_t digits = token->literal_length - i;
+    if (digits == 0 || digits > 9) return false; /* Keep products within 64 bits. */
+
+    int64_t magnitude = 0;
+    for (; i < token->literal_length; ++i) {
+        if (!is_digit_ascii(token->literal[i])) return false;
+        magnitude = magnitude * 10 + (token->literal[i] - '0');
+    }
+
+    *value = token->literal[0] == '-' ? -magnitude : magnitude;
+    return true;
+}
+
+/* Whether an integer between the tokens at before and after would stand alone as an item of ORDER BY or GROUP BY,
+ * where it is read as a column position instead of a constant. Parentheses wrapping only the integer do not count,
+ * since PostgreSQL drops them before it looks for positions. */
+bool rewrite_is_column_position(const Token *tokens, size_t before, Token_Kind after)
+{
+    switch (after) {
+    case Token_Kind__None:
+    case Token_Kind__Comma:
+    case Token_Kind__Asc:
+    case Token_Kind__Desc:
+    case Token_Kind__Identifier: /* NULLS FIRST or NULLS LAST. */
+    case Token_Kind__Having:
+    case Token_Kind__Order:
+    case Token_Kind__Limit:
+    case Token_Kind__Offset:
+    case Token_Kind__Union:
+    case Token_Kind__Returning:
+    case Token_Kind__Parenthesis_Close:
+    case Token_Kind__Semicolon: break;
+    default: return false;
+    }
+
+    if (after == Token_Kind__Parenthesis_Close) {
+        while (before > 0 && tokens[before].kind == Token_Kind__Parenthesis_Open) --before;
+    }
+    if (tokens[before].kind != Token_Kind__By && tokens[before].kind != Token_Kind__Comma) return false;
+
+    size_t depth = 0;
+    for (size_t i = before + 1; i-- > 0;) {
+        switch (tokens[i].kind) {
+        case Token_Kind__Parenthesis_Close: ++depth; break;
+        case Token_Kind__Parenthesis_Open: if (depth-- == 0) return false; break;
+
+        case Token_Kind__By: {
+            if (depth > 0) break;
+            return i > 0 && (tokens[i - 1].kind == Token_Kind__Order || tokens[i - 1].kind == Token_Kind__Group);
+        }
+
+        case Token_Kind__Select:
+        case Token_Kind__From:
+        case Token_Kind__Where:
+        case Token_Kind__Having:
+        case Token_Kind__Values:
+        case Token_Kind__Semicolon: if (depth == 0) return false; break;
+
+        default: break;
+        }
+    }
+
+    return false;
+}
+
+/* Folds the last three tokens if they are an integer operation whose neighbours cannot bind its operands. */
+bool rewrite_fold_top(Lexer *lexer, Dialect dialect, size_t used, const Token *next)
+{
+    Token *left = &lexer->tokens[used - 3];
+    Token *operator = &lexer->tokens[used - 2];
+    Token *right = &lexer->tokens[used - 1];
+
+    int64_t a, b;
+    if (!rewrite_integer_value(left, &a) || !rewrite_integer_value(right, &b)) return false;
+
+    Token_Kind before = used >= 4 ? lexer->tokens[used - 4].kind : Token_Kind__None;
+    Token_Kind after = next != NULL ? next->kind : Token_Kind__None;
+    bool before_multiplicative = before == Token_Kind__Asterisk || before == Token_Kind__Slash;
+
+    int64_t result;
+    switch (operator->kind) {
+    case Token_Kind__Plus:
+    case Token_Kind__Minus: {
+        /* Oracle gives || the same precedence as + and -. */
+        if (before_multiplicative || before == Token_Kind__Plus || before == Token_Kind__Minus || before == Token_Kind__Double_Pipe) return false;
+        if (after == Token_Kind__Asterisk || after == Token_Kind__Slash) return false;
+        result = operator->kind == Token_Kind__Plus ? a + b : a - b;
+    } break;
+
+    case Token_Kind__Asterisk: {
+        if (before_multiplicative) return false;
+        result = a * b;
+    } break;
+
+    case Token_Kind__Slash: {
+        if (dialect == Dialect__MySql) return false; /* Division always yields a decimal there. */
+        if (before_multiplicative || b == 0 || a % b != 0) return false;
+        result = a / b;
+    } break;
+
+    default: return false;
     }
 
-    printf("Tokens generated: x%zu\n", lexer.tokens_used);
+    if (result < INT32_MIN || result > INT32_MAX) return false;
+    if (used >= 4 && rewrite_is_column_position(lexer->tokens, used - 4, after)) return false;
 
-    for (size_t i = 0; i < lexer.tokens_used; ++i) {
-        printf("Token #%zu: ", i);
-        print_token(&lexer.tokens[i]);
-        printf("\n");
+    char buffer[16];
+    int length = snprintf(buffer, sizeof buffer, "%lld", (long long)result);
+    left->literal = arena_duplicate_string(lexer->strings, buffer, length);
+    left->literal_length = length;
+    return true;
+}
+
+size_t rewrite_fold_constants(Lexer *lexer, Dialect dialect)
+{
+    size_t folded = 0;
+    size_t used = 0;
+
+    for (size_t i = 0; i < lexer->tokens_used; ++i) {
+        lexer->tokens[used++] = lexer->tokens[i];
+
+        const Token *next = i + 1 < lexer->tokens_used ? &lexer->tokens[i + 1] : NULL;
+        while (used >= 3 && rewrite_fold_top(lexer, dialect, used, next)) {
+            used -= 2;
+            ++folded;
+        }
+    }
+
+    lexer->tokens_used = used;
+    return folded;
+}
+
+/* Finds the THEN closing the only WHEN branch of a CASE, whose condition starts at begin. */
+bool rewrite_find_single_then(const Token *tokens, size_t begin, size_t count, size_t *then)
+{
+    size_t depth = 0;
+    size_t case_depth = 0;
+
+    for (size_t i = begin; i < count; ++i) {
+        switch (tokens[i].kind) {
+        case Token_Kind__Parenthesis_Open: ++depth; break;
+        case Token_Kind__Parenthesis_Close: if (depth-- == 0) return false; break;
+        case Token_Kind__Case: ++case_depth; break;
+        case Token_Kind__End: if (case_depth-- == 0) return false; break;
+        case Token_Kind__Semicolon: return false;
+
+        case Token_Kind__Then: {
+            if (depth > 0 || case_depth > 0) break;
+            *then = i;
+            return i > begin;
+        }
+
+        case Token_Kind__When:
+        case Token_Kind__Else: if (depth == 0 && case_depth == 0) return false; break;
+
+        default: break;
+        }
+    }
+
+    return false;
+}
+
+/* COUNT(CASE WHEN c THEN x END) becomes COUNT(*) FILTER (WHERE c) for a non-null literal x. Both forms have
+ * the same number of tokens, so the condition is only shifted. */
+size_t rewrite_count_case_to_filter(Lexer *lexer)
+{
+    Token *tokens = lexer->tokens;
+    size_t count = lexer->tokens_used;
+    size_t fired = 0;
+
+    for (size_t i = 0; i + 8 < count; ++i) {
+        if (tokens[i].kind != Token_Kind__Count || tokens[i + 1].kind != Token_Kind__Parenthesis_Open
+            || tokens[i + 2].kind != Token_Kind__Case || tokens[i + 3].kind != Token_Kind__When) continue;
+
+        size_t then;
+        if (!rewrite_find_single_then(tokens, i + 4, count, &then) || then + 3 >= count) continue;
+        if (tokens[then + 1].kind != Token_Kind__Literal_Number && tokens[then + 1].kind != Token_Kind__Literal_Text) continue;
+        if (tokens[then + 2].kind != Token_Kind__End || tokens[then + 3].kind != Token_Kind__Parenthesis_Close) continue;
+
+        Token case_token = tokens[i + 2];
+        Token when_token = tokens[i + 3];
+        memmove(&tokens[i + 7], &tokens[i + 4], (then - (i + 4)) * sizeof tokens[0]);
+
+        token_rewrite(&tokens[i + 2], Token_Kind__Asterisk, &case_token);
+        token_rewrite(&tokens[i + 3], Token_Kind__Parenthesis_Close, &case_token);
+        token_rewrite(&tokens[i + 4], Token_Kind__Filter, &when_token);
+        token_rewrite(&tokens[i + 5], Token_Kind__Parenthesis_Open, &when_token);
+        token_rewrite(&tokens[i + 6], Token_Kind__Where, &when_token);
+        ++fired;
+    }
+
+    return fired;
+}
+
+/* Scans the current query level for a token of kind, stopping where the query ends. Returns count if absent. */
+size_t rewrite_find_clause(const Token *tokens, size_t begin, size_t count, Token_Kind kind)
+{
+    size_t depth = 0;
+
+    for (size_t i = begin; i < count; ++i) {
+        Token_Kind current = tokens[i].kind;
+        if (depth == 0 && current == kind) return i;
+
+        if (current == Token_Kind__Parenthesis_Open) ++depth;
+        else if (current == Token_Kind__Parenthesis_Close) {
+            if (depth == 0) return count;
+            --depth;
+        } else if (current == Token_Kind__Semicolon || (depth == 0 && current == Token_Kind__Union)) return count;
+    }
+
+    return count;
+}
+
+size_t rewrite_group_by_end(const Token *tokens, size_t begin, size_t count)
+{
+    size_t depth = 0;
+
+    for (size_t i = begin; i < count; ++i) {
+        switch (tokens[i].kind) {
+        case Token_Kind__Parenthesis_Open: ++depth; break;
+        case Token_Kind__Parenthesis_Close: if (depth-- == 0) return i; break;
+        case Token_Kind__Semicolon: return i;
+
+        case Token_Kind__Having:
+        case Token_Kind__Order:
+        case Token_Kind__Limit:
+        case Token_Kind__Offset:
+        case Token_Kind__Union: if (depth == 0) return i; break;
+
+        default: break;
+        }
+    }
+
+    return count;
+}
+
+/* Returns the comma ending the list item starting at begin, or end. */
+size_t rewrite_item_end(const Token *tokens, size_t begin, size_t end)
+{
+    size_t depth = 0;
+
+    for (size_t i = begin; i < end; ++i) {
+        if (tokens[i].kind == Token_Kind__Parenthesis_Open) ++depth;
+        else if (tokens[i].kind == Token_Kind__Parenthesis_Close) --depth;
+        else if (depth == 0 && tokens[i].kind == Token_Kind__Comma) return i;
+    }
+
+    return end;
+}
+
+/* Returns the end of a select item without its alias, as in "expression AS alias" or "expression alias". */
+size_t rewrite_strip_alias(const Token *tokens, size_t begin, size_t end)
+{
+    if (end - begin < 2 || tokens[end - 1].kind != Token_Kind__Identifier) return end;
+    if (end - begin >= 3 && tokens[end - 2].kind == Token_Kind__As) return end - 2;
+
+    Token_Kind before = tokens[end - 2].kind;
+    if (before == Token_Kind__Identifier || before == Token_Kind__Parenthesis_Close
+        || before == Token_Kind__Literal_Number || before == Token_Kind__Literal_Text) return end - 1;
+
+    return end;
+}
+
+bool rewrite_spans_equal(const Lexer *lexer, size_t first, size_t first_end, size_t second, size_t second_end)
+{
+    if (first_end - first != second_end - second) return false;
+
+    for (size_t i = 0; i < first_end - first; ++i) {
+        if (!tokens_equal(lexer, &lexer->tokens[first + i], &lexer->tokens[second + i])) return false;
+    }
+    return true;
+}
+
+/* Returns the index after the parenthesis closing the one at begin, or end if it is not closed before end. */
+size_t rewrite_parenthesis_end(const Token *tokens, size_t begin, size_t end)
+{
+    size_t depth = 0;
+
+    for (size_t i = begin; i < end; ++i) {
+        if (tokens[i].kind == Token_Kind__Parenthesis_Open) ++depth;
+        else if (tokens[i].kind == Token_Kind__Parenthesis_Close && --depth == 0) return i + 1;
+    }
+
+    return end;
+}
+
+/* Whether the select item between begin and end takes a single value per group: a literal, or a call to COUNT, SUM,
+ * AVG, MIN or MAX, optionally with a FILTER clause. */
+bool rewrite_is_single_valued(const Token *tokens, size_t begin, size_t end)
+{
+    if (end - begin == 1) return tokens[begin].kind == Token_Kind__Literal_Number || tokens[begin].kind == Token_Kind__Literal_Text;
+
+    switch (tokens[begin].kind) {
+    case Token_Kind__Count:
+    case Token_Kind__Sum:
+    case Token_Kind__Avg:
+    case Token_Kind__Min:
+    case Token_Kind__Max: break;
+    default: return false;
+    }
+
+    if (begin + 1 >= end || tokens[begin + 1].kind != Token_Kind__Parenthesis_Open) return false;
+    size_t call_end = rewrite_parenthesis_end(tokens, begin + 1, end);
+    if (call_end == end) return tokens[end - 1].kind == Token_Kind__Parenthesis_Close;
+
+    if (tokens[call_end].kind != Token_Kind__Filter || call_end + 1 >= end) return false;
+    if (tokens[call_end + 1].kind != Token_Kind__Parenthesis_Open) return false;
+    return rewrite_parenthesis_end(tokens, call_end + 1, end) == end && tokens[end - 1].kind == Token_Kind__Parenthesis_Close;
+}
+
+/* Whether the span between begin and end is one of the GROUP BY items between group and group_end. */
+bool rewrite_is_grouped(const Lexer *lexer, size_t begin, size_t end, size_t group, size_t group_end)
+{
+    for (size_t item = group; item < group_end; ++item) {
+        size_t item_end = rewrite_item_end(lexer->tokens, item, group_end);
+        if (rewrite_spans_equal(lexer, begin, end, item, item_end)) return true;
+        item = item_end;
+    }
+    return false;
+}
+
+/* SELECT DISTINCT is redundant when every GROUP BY expression is selected and every other selected item is a literal
+ * or an aggregate, since each group then yields a single row of its own. */
+bool rewrite_distinct_is_redundant(const Lexer *lexer, size_t select)
+{
+    const Token *tokens = lexer->tokens;
+    size_t count = lexer->tokens_used;
+
+    size_t from = rewrite_find_clause(tokens, select + 2, count, Token_Kind__From);
+    if (from == count) return false;
+
+    size_t group = rewrite_find_clause(tokens, from + 1, count, Token_Kind__Group);
+    if (group + 1 >= count || tokens[group + 1].kind != Token_Kind__By) return false;
+
+    size_t group_end = rewrite_group_by_end(tokens, group + 2, count);
+    if (group_end == group + 2) return false;
+
+    for (size_t item = group + 2; item < group_end; ++item) {
+        size_t item_end = rewrite_item_end(tokens, item, group_end);
+        if (item_end == item) return false;
+
+        bool selected = false;
+        for (size_t column = select + 2; column < from && !selected; ++column) {
+            size_t column_end = rewrite_item_end(tokens, column, from);
+            selected = rewrite_spans_equal(lexer, item, item_end, column, rewrite_strip_alias(tokens, column, column_end));
+            column = column_end;
+        }
+        if (!selected) return false;
+
+        item = item_end;
+    }
+
+    /* Unique groups only make unique rows if nothing, like a set-returning function, yields several per group. */
+    for (size_t column = select + 2; column < from; ++column) {
+        size_t column_end = rewrite_item_end(tokens, column, from);
+        size_t value_end = rewrite_strip_alias(tokens, column, column_end);
+        if (!rewrite_is_single_valued(tokens, column, value_end) && !rewrite_is_grouped(lexer, column, value_end, group + 2, group_end)) return false;
+        column = column_end;
+    }
+
+    return true;
+}
+
+size_t rewrite_drop_grouped_distinct(Lexer *lexer)
+{
+    size_t fired = 0;
+
+    for (size_t i = 0; i + 2 < lexer->tokens_used; ++i) {
+        if (lexer->tokens[i].kind != Token_Kind__Select || lexer->tokens[i + 1].kind != Token_Kind__Distinct) continue;
+        if (lexer->tokens[i + 2].kind == Token_Kind__On) continue; /* DISTINCT ON picks rows, it does not dedupe. */
+        if (!rewrite_distinct_is_redundant(lexer, i)) continue;
+
+        memmove(&lexer->tokens[i + 1], &lexer->tokens[i + 2], (lexer->tokens_used - (i + 2)) * sizeof lexer->tokens[0]);
+        --lexer->tokens_used;
+        ++fired;
+    }
+
+    return fired;
+}
+
+/* Rewrites a batch of whole statements into faster equivalents for dialect, counting the rules fired. */
+void rewrite_tokens(Lexer *lexer, Dialect dialect, Rewrite_Report *report)
+{
+    if (dialect == Dialect__Postgres) report->fired[Rewrite_Rule__Count_Case_To_Filter] += rewrite_count_case_to_filter(lexer);
+    report->fired[Rewrite_Rule__Drop_Grouped_Distinct] += rewrite_drop_grouped_distinct(lexer);
+    report->fired[Rewrite_Rule__Fold_Constants] += rewrite_fold_constants(lexer, dialect);
+}
+
+/* Rewrites the whole statements of a batch, leaving alone those cut between batches, which no rule could see
+ * entirely. */
+void rewrite_batch(const Lexer *lexer, Token_Batch *batch, Dialect dialect, Rewrite_Report *report)
+{
+    size_t begin = 0;
+    size_t end = batch->tokens_used;
+
+    if (batch->continues_statement) {
+        while (begin < end && batch->tokens[begin].kind != Token_Kind__Semicolon) ++begin;
+        if (begin < end) ++begin;
+    }
+    if (batch->cuts_statement) {
+        while (end > begin && batch->tokens[end - 1].kind != Token_Kind__Semicolon) --end;
+    }
+
+    Lexer window = {0};
+    window.begin = lexer->begin;
+    window.end = lexer->end;
+    window.tokens = &batch->tokens[begin];
+    window.tokens_used = end - begin;
+    window.strings = batch->strings;
+    rewrite_tokens(&window, dialect, report);
+
+    memmove(&batch->tokens[begin + window.tokens_used], &batch->tokens[end], (batch->tokens_used - end) * sizeof batch->tokens[0]);
+    batch->tokens_used = begin + window.tokens_used + (batch->tokens_used - end);
+}
+
+#define SOURCE_MAP_MAGIC "SSQLMAP1"
+#define SOURCE_MAP_MAGIC_LENGTH 8
+#define SOURCE_MAP_CHECKPOINT_INTERVAL 64
+#define SOURCE_MAP_TRAILER_LENGTH 8 /* The emitted SQL length, little-endian, after the mappings. */
+
+void source_map_writer_flush(Source_Map_Writer *writer)
+{
+    fwrite(writer->buffer, 1, writer->buffer_used, writer->output);
+    writer->buffer_used = 0;
+}
+
+void source_map_writer_setup(Source_Map_Writer *writer, FILE *output)
+{
+    writer->output = output;
+    writer->previous = (Source_Mapping){0};
+    writer->mappings_written = 0;
+    writer->buffer_used = 0;
+    fwrite(SOURCE_MAP_MAGIC, 1, SOURCE_MAP_MAGIC_LENGTH, output);
+}
+
+void source_map_writer_finish(Source_Map_Writer *writer, size_t emitted_length)
+{
+    source_map_writer_flush(writer);
+
+    uint8_t trailer[SOURCE_MAP_TRAILER_LENGTH];
+    for (size_t i = 0; i < SOURCE_MAP_TRAILER_LENGTH; ++i) trailer[i] = (uint64_t)emitted_length >> (i * 8);
+    fwrite(trailer, 1, SOURCE_MAP_TRAILER_LENGTH, writer->output);
+    fflush(writer->output);
+}
+
+void source_map_write_varint(Source_Map_Writer *writer, uint64_t value)
+{
+    if (value < 0x80) { /* Most deltas fit a single byte. */
+        writer->buffer[writer->buffer_used++] = (uint8_t)value;
+        return;
+    }
+
+    do {
+        uint8_t byte = value & 0x7F;
+        value >>= 7;
+        writer->buffer[writer->buffer_used++] = value != 0 ? byte | 0x80 : byte;
+    } while (value != 0);
+}
+
+uint64_t zigzag_encode(int64_t value)
+{
+    return value < 0 ? ~((uint64_t)value << 1) : (uint64_t)value << 1;
+}
+
+int64_t zigzag_decode(uint64_t value)
+{
+    return (value & 1) ? (int64_t)~(value >> 1) : (int64_t)(value >> 1);
+}
+
+/* Appends a mapping as three varints: the output offset delta, then the signed line and column deltas. Offsets
+ * must not decrease. Mappings lying where the previous one already predicts, as when emitted tokens keep their
+ * source spacing, are left out and recovered on lookup. */
+void source_map_write(Source_Map_Writer *writer, Source_Mapping mapping)
+{
+    assert(mapping.offset >= writer->previous.offset);
+
+    size_t advance = mapping.offset - writer->previous.offset;
+    if (writer->mappings_written > 0 && mapping.line == writer->previous.line
+        && (size_t)mapping.column == writer->previous.column + advance) return;
+
+    if (writer->buffer_used + 3 * 10 > sizeof writer->buffer) source_map_writer_flush(writer);
+
+    source_map_write_varint(writer, advance);
+    source_map_write_varint(writer, zigzag_encode((int64_t)mapping.line - writer->previous.line));
+    source_map_write_varint(writer, zigzag_encode((int64_t)mapping.column - writer->previous.column));
+    writer->previous = mapping;
+    ++writer->mappings_written;
+}
+
+bool source_map_read_varint(const uint8_t **head, const uint8_t *end, uint64_t *value)
+{
+    *value = 0;
+    for (unsigned shift = 0; *head < end && shift < 64; shift += 7) {
+        uint8_t byte = *(*head)++;
+        *value |= (uint64_t)(byte & 0x7F) << shift;
+        if ((byte & 0x80) == 0) return true;
+    }
+    return false;
+}
+
+bool source_map_read(const uint8_t **head, const uint8_t *end, Source_Mapping *mapping)
+{
+    uint64_t offset, line, column;
+    if (!source_map_read_varint(head, end, &offset)) return false;
+    if (!source_map_read_varint(head, end, &line)) return false;
+    if (!source_map_read_varint(head, end, &column)) return false;
+
+    mapping->offset += offset;
+    mapping->line += zigzag_decode(line);
+    mapping->column += zigzag_decode(column);
+    return true;
+}
+
+void source_map_unload(Source_Map *map)
+{
+    if (map == NULL) return;
+
+    if (map->data != NULL) {
+        free(map->data);
+        map->data = NULL;
+    }
+
+    if (map->checkpoints != NULL) {
+        free(map->checkpoints);
+        map->checkpoints = NULL;
+    }
+}
+
+char *read_entire_file(const char *path, size_t *length);
+
+/* Loads a source map, keeping every SOURCE_MAP_CHECKPOINT_INTERVAL-th mapping decoded so lookups can start
+ * from the nearest one. */
+bool source_map_load(Source_Map *map, const char *path)
+{
+    *map = (Source_Map){0};
+
+    size_t length;
+    char *content = read_entire_file(path, &length);
+    if (content == NULL) return false;
+    if (length < SOURCE_MAP_MAGIC_LENGTH + SOURCE_MAP_TRAILER_LENGTH || memcmp(content, SOURCE_MAP_MAGIC, SOURCE_MAP_MAGIC_LENGTH) != 0) {
+        free(content);
+        return false;
+    }
+
+    map->data = (uint8_t *)content;
+    map->data_length = length - SOURCE_MAP_TRAILER_LENGTH;
+
+    uint64_t emitted_length = 0;
+    for (size_t i = 0; i < SOURCE_MAP_TRAILER_LENGTH; ++i) emitted_length |= (uint64_t)map->data[map->data_length + i] << (i * 8);
+    map->emitted_length = emitted_length;
+
+    size_t checkpoints_allocated = 0;
+    const uint8_t *head = map->data + SOURCE_MAP_MAGIC_LENGTH;
+    const uint8_t *end = map->data + map->data_length;
+    Source_Mapping mapping = {0};
+
+    for (size_t i = 0; head < end; ++i) {
+        if (!source_map_read(&head, end, &mapping)) {
+            source_map_unload(map);
+            return false;
+        }
+
+        if (i % SOURCE_MAP_CHECKPOINT_INTERVAL != 0) continue;
+
+        if (map->checkpoints_used >= checkpoints_allocated) {
+            checkpoints_allocated = checkpoints_allocated == 0 ? 64 : checkpoints_allocated * 2;
+            map->checkpoints = realloc(map->checkpoints, checkpoints_allocated * sizeof map->checkpoints[0]);
+            assert(map->checkpoints != NULL);
+        }
+        map->checkpoints[map->checkpoints_used++] = (Source_Map_Checkpoint){head - map->data, mapping};
+    }
+
+    return true;
+}
+
+/* Finds the source location of offset in the emitted SQL, in O(log n). */
+bool source_map_lookup(const Source_Map *map, size_t offset, Source_Mapping *result)
+{
+    if (offset >= map->emitted_length) return false;
+
+    size_t low = 0;
+    size_t high = map->checkpoints_used;
+    while (low < high) {
+        size_t middle = low + (high - low) / 2;
+        if (map->checkpoints[middle].mapping.offset <= offset) low = middle + 1;
+        else high = middle;
+    }
+    if (low == 0) return false;
+
+    const Source_Map_Checkpoint *checkpoint = &map->checkpoints[low - 1];
+    const uint8_t *head = map->data + checkpoint->data_offset;
+    const uint8_t *end = map->data + map->data_length;
+
+    *result = checkpoint->mapping;
+    for (size_t i = 1; i < SOURCE_MAP_CHECKPOINT_INTERVAL && head < end; ++i) {
+        Source_Mapping next = *result;
+        if (!source_map_read(&head, end, &next) || next.offset > offset) break;
+        *result = next;
+    }
+
+    result->column += offset - result->offset;
+    result->offset = offset;
+    return true;
+}
+
+void emitter_setup(Emitter *emitter, FILE *output, bool deduplicate, Source_Map_Writer *source_map)
+{
+    *emitter = (Emitter){0};
+    emitter->output = output;
+    emitter->deduplicate = deduplicate;
+    emitter->source_map = source_map;
+}
+
+void emitter_teardown(Emitter *emitter)
+{
+    if (emitter == NULL) return;
+
+    if (emitter->statement != NULL) {
+        free(emitter->statement);
+        emitter->statement = NULL;
+    }
+
+    if (emitter->statement_mappings != NULL) {
+        free(emitter->statement_mappings);
+        emitter->statement_mappings = NULL;
+    }
+
+    if (emitter->seen != NULL) {
+        free(emitter->seen);
+        emitter->seen = NULL;
+    }
+
+    if (emitter->seen_texts != NULL) {
+        arena_destroy(emitter->seen_texts);
+        emitter->seen_texts = NULL;
+    }
+}
+
+Emit_Class emit_class(const Lexer *lexer, const Token *token)
+{
+    switch (token->kind) {
+    case Token_Kind__Identifier: return token_is_quoted(lexer, token) ? Emit_Class__Quoted : Emit_Class__Word;
+    case Token_Kind__Literal_Number: return Emit_Class__Word;
+    case Token_Kind__Literal_Text: return Emit_Class__Quoted;
+
+    case Token_Kind__Comma:
+    case Token_Kind__Dot:
+    case Token_Kind__Parenthesis_Close:
+    case Token_Kind__Parenthesis_Open:
+    case Token_Kind__Semicolon: return Emit_Class__Punctuation;
+
+    case Token_Kind__Asterisk:
+    case Token_Kind__Equals:
+    case Token_Kind__Greater:
+    case Token_Kind__Greater_Equals:
+    case Token_Kind__Lesser:
+    case Token_Kind__Lesser_Equals:
+    case Token_Kind__Minus:
+    case Token_Kind__Not_Equals:
+    case Token_Kind__Double_Pipe:
+    case Token_Kind__Plus:
+    case Token_Kind__Slash: return Emit_Class__Operator;
+
+    default: return Emit_Class__Word;
+    }
+}
+
+/* Returns the separator token needs from the previously emitted one so they neither merge nor change meaning,
+ * or '\0' when none is needed. */
+char emitter_separator(const Emitter *emitter, Emit_Class class, const Token *token)
+{
+    /* Adjacent text literals are only concatenated when a newline separates them. */
+    if (emitter->previous_kind == Token_Kind__Literal_Text && token->kind == Token_Kind__Literal_Text) return '\n';
+
+    bool negative = token->kind == Token_Kind__Literal_Number && token->literal[0] == '-';
+
+    switch (emitter->previous_class) {
+    case Emit_Class__Word: if (class == Emit_Class__Word || class == Emit_Class__Quoted) return ' '; break; /* Also avoids E'' and N'' prefixes. */
+    case Emit_Class__Quoted: if (class == Emit_Class__Quoted) return ' '; break; /* Doubled quotes are escapes. */
+    case Emit_Class__Operator: if (class == Emit_Class__Operator || negative) return ' '; break; /* Avoids -- and operator names like <> or ||-. */
+    default: break;
+    }
+
+    if ((emitter->previous_kind == Token_Kind__Literal_Number && token->kind == Token_Kind__Dot)
+        || (emitter->previous_kind == Token_Kind__Dot && token->kind == Token_Kind__Literal_Number)) return ' ';
+    return '\0';
+}
+
+void emitter_write_characters(Emitter *emitter, const char *text, size_t length, size_t characters)
+{
+    if (!emitter->deduplicate) {
+        fwrite(text, 1, length, emitter->output);
+        emitter->written += characters;
+        return;
+    }
+
+    if (emitter->statement_used + length > emitter->statement_allocated) {
+        while (emitter->statement_used + length > emitter->statement_allocated) {
+            emitter->statement_allocated = emitter->statement_allocated == 0 ? 256 : emitter->statement_allocated * 2;
+        }
+        emitter->statement = realloc(emitter->statement, emitter->statement_allocated);
+        assert(emitter->statement != NULL);
+    }
+
+    memcpy(&emitter->statement[emitter->statement_used], text, length);
+    emitter->statement_used += length;
+    emitter->statement_written += characters;
+}
+
+/* Writes text known to be ASCII, as separators, keywords, symbols and numbers are. */
+void emitter_write(Emitter *emitter, const char *text, size_t length)
+{
+    emitter_write_characters(emitter, text, length, length);
+}
+
+/* Writes identifier or string text, whose characters are only counted when a source map needs them and the token
+ * was not found to be ASCII. */
+void emitter_write_text(Emitter *emitter, const char *text, size_t length)
+{
+    bool counted = emitter->source_map != NULL && !emitter->batch_ascii && !emitter->token_ascii;
+    emitter_write_characters(emitter, text, length, counted ? utf8_count_runes(text, length) : length);
+}
+
+uint64_t hash_fnv1a(const char *data, size_t length)
+{
+    uint64_t hash = 0xCBF29CE484222325ull;
+    for (size_t i = 0; i < length; ++i) {
+        hash ^= (uint8_t)data[i];
+        hash *= 0x100000001B3ull;
+    }
+    return hash;
+}
+
+/* Finds the slot of the statement equal to key in the open addressed set, or the empty slot where it belongs. */
+Statement_Key *emitter_find_statement(Emitter *emitter, Statement_Key key)
+{
+    size_t mask = emitter->seen_allocated - 1;
+    for (size_t i = key.hash & mask;; i = (i + 1) & mask) {
+        Statement_Key *slot = &emitter->seen[i];
+        if (slot->length == 0) return slot;
+        if (slot->hash == key.hash && slot->length == key.length && memcmp(slot->text, key.text, key.length) == 0) return slot;
+    }
+}
+
+/* Records a statement, returning false if an identical one was already recorded. Hash matches are confirmed
+ * byte by byte, so distinct statements are never taken for duplicates. */
+bool emitter_remember_statement(Emitter *emitter, const char *text, size_t length)
+{
+    if ((emitter->seen_used + 1) * 2 > emitter->seen_allocated) {
+        Statement_Key *old = emitter->seen;
+        size_t old_allocated = emitter->seen_allocated;
+
+        emitter->seen_allocated = old_allocated == 0 ? 64 : old_allocated * 2;
+        emitter->seen = calloc(emitter->seen_allocated, sizeof emitter->seen[0]);
+        assert(emitter->seen != NULL);
+
+        for (size_t i = 0; i < old_allocated; ++i) {
+            if (old[i].length != 0) *emitter_find_statement(emitter, old[i]) = old[i];
+        }
+        free(old);
+    }
+
+    Statement_Key key = {hash_fnv1a(text, length), length, text};
+    Statement_Key *slot = emitter_find_statement(emitter, key);
+    if (slot->length != 0) return false;
+
+    if (emitter->seen_texts == NULL) emitter->seen_texts = arena_create(64 * 1024);
+    key.text = arena_duplicate_string(emitter->seen_texts, text, length);
+    *slot = key;
+    ++emitter->seen_used;
+    return true;
+}
+
+/* Writes out the buffered statement unless an identical one was already emitted. Every distinct statement is
+ * kept to compare against, so memory grows with the distinct statements, not with the duplicates. */
+void emitter_end_statement(Emitter *emitter)
+{
+    if (!emitter->deduplicate || emitter->statement_used == 0) return;
+
+    if (emitter_remember_statement(emitter, emitter->statement, emitter->statement_used)) {
+        for (size_t i = 0; i < emitter->statement_mappings_used; ++i) {
+            Source_Mapping mapping = emitter->statement_mappings[i];
+            mapping.offset += emitter->written;
+            source_map_write(emitter->source_map, mapping);
+        }
+
+        fwrite(emitter->statement, 1, emitter->statement_used, emitter->output);
+        emitter->written += emitter->statement_written;
+    } else {
+        emitter->previous_class = emitter->statement_previous_class;
+        emitter->previous_kind = emitter->statement_previous_kind;
+        ++emitter->statements_dropped;
+    }
+
+    emitter->statement_used = 0;
+    emitter->statement_written = 0;
+    emitter->statement_mappings_used = 0;
+}
+
+/* Returns whether the input from begin to end is ASCII, growing the known run by scanning ahead a chunk at a time. */
+bool emitter_source_is_ascii(Emitter *emitter, const Lexer *lexer, size_t begin, size_t end)
+{
+    if (end > emitter->source_ascii_end) {
+        if (emitter->source_ascii_end < begin) emitter->source_ascii_begin = emitter->source_ascii_end = begin;
+
+        size_t remaining = (size_t)(lexer->end - lexer->begin) - emitter->source_ascii_end;
+        size_t chunk = end - emitter->source_ascii_end + LEXER_VALIDATION_CHUNK;
+        emitter->source_ascii_end += ascii_prefix(lexer->begin + emitter->source_ascii_end, remaining < chunk ? remaining : chunk);
+    }
+    return begin >= emitter->source_ascii_begin && end <= emitter->source_ascii_end;
+}
+
+/* Counts the characters before a token on its line. Where the input is ASCII from the line start to past the token's
+ * literal, that is its offset. Otherwise counting goes on from the last token counted when it comes earlier on the
+ * same line, so each line is counted about once. */
+uint32_t emitter_source_column(Emitter *emitter, const Lexer *lexer, const Token *token)
+{
+    if (emitter->batch_ascii) return token->offset;
+
+    size_t line_start = token->position - token->offset;
+    size_t end = token->position + token->literal_length + 1; /* Literals start at most one quote into the token. */
+    emitter->token_ascii = emitter_source_is_ascii(emitter, lexer, line_start, end);
+    if (emitter->token_ascii) return token->offset;
+
+    if (token->line != emitter->source_line || token->position < emitter->source_position) {
+        emitter->source_line = token->line;
+        emitter->source_position = line_start;
+        emitter->source_column = 0;
+    }
+
+    emitter->source_column += utf8_count_runes(lexer->begin + emitter->source_position, token->position - emitter->source_position);
+    emitter->source_position = token->position;
+    return emitter->source_column;
+}
+
+/* Maps the token about to be written back to its source location. While deduplicating, offsets are relative
+ * to the buffered statement until it is written out. */
+void emitter_map_token(Emitter *emitter, const Lexer *lexer, const Token *token)
+{
+    if (emitter->source_map == NULL) return;
+
+    Source_Mapping mapping = {emitter->written, token->line, emitter_source_column(emitter, lexer, token)};
+    if (!emitter->deduplicate) {
+        source_map_write(emitter->source_map, mapping);
+        return;
+    }
+
+    if (emitter->statement_mappings_used >= emitter->statement_mappings_allocated) {
+        emitter->statement_mappings_allocated = emitter->statement_mappings_allocated == 0 ? 64 : emitter->statement_mappings_allocated * 2;
+        emitter->statement_mappings = realloc(emitter->statement_mappings, emitter->statement_mappings_allocated * sizeof emitter->statement_mappings[0]);
+        assert(emitter->statement_mappings != NULL);
+    }
+
+    mapping.offset = emitter->statement_written;
+    emitter->statement_mappings[emitter->statement_mappings_used++] = mapping;
+}
+
+void emitter_emit_token(Emitter *emitter, const Lexer *lexer, const Token *token)
+{
+    if (emitter->deduplicate && emitter->statement_used == 0) {
+        emitter->statement_previous_class = emitter->previous_class;
+        emitter->statement_previous_kind = emitter->previous_kind;
+    }
+
+    Emit_Class class = emit_class(lexer, token);
+    char separator = emitter_separator(emitter, class, token);
+    if (separator != '\0') emitter_write(emitter, &separator, 1);
+    emitter_map_token(emitter, lexer, token);
+
+    switch (token->kind) {
+    case Token_Kind__Identifier: {
+        bool quoted = class == Emit_Class__Quoted;
+        if (quoted) emitter_write(emitter, "\"", 1);
+        emitter_write_text(emitter, token->literal, token->literal_length);
+        if (quoted) emitter_write(emitter, "\"", 1);
+    } break;
+
+    case Token_Kind__Literal_Text: {
+        emitter_write(emitter, "'", 1);
+        emitter_write_text(emitter, token->literal, token->literal_length);
+        emitter_write(emitter, "'", 1);
+    } break;
+
+    case Token_Kind__Literal_Number: emitter_write(emitter, token->literal, token->literal_length); break;
+
+    default: {
+        const char *text = token_kind_text(token->kind);
+        emitter_write(emitter, text, strlen(text));
+    } break;
+    }
+
+    emitter->previous_class = class;
+    emitter->previous_kind = token->kind;
+
+    if (token->kind == Token_Kind__Semicolon) emitter_end_statement(emitter);
+}
+
+/* Streams a batch of tokens out as minified SQL: no comments, canonical keyword case and spaces only where
+ * tokens would otherwise merge. */
+/* Forgets the statements seen so far, so deduplication holds at most a batch of them. */
+void emitter_forget_statements(Emitter *emitter)
+{
+    if (emitter->seen_used == 0) return;
+
+    memset(emitter->seen, 0, emitter->seen_allocated * sizeof emitter->seen[0]);
+    emitter->seen_used = 0;
+    arena_reset(emitter->seen_texts);
+}
+
+/* Returns whether the input under every token of a batch is ASCII, so none of them needs its characters counted.
+ * Rewritten tokens keep positions from within their batch, but not necessarily in order. */
+bool emitter_batch_is_ascii(Emitter *emitter, const Lexer *lexer, const Token_Batch *batch)
+{
+    if (emitter->source_map == NULL || batch->tokens_used == 0) return false;
+
+    size_t begin = SIZE_MAX;
+    size_t end = 0;
+    for (size_t i = 0; i < batch->tokens_used; ++i) {
+        const Token *token = &batch->tokens[i];
+        size_t line_start = token->position - token->offset;
+        size_t token_end = token->position + token->literal_length + 1;
+        if (line_start < begin) begin = line_start;
+        if (token_end > end) end = token_end;
+    }
+    return emitter_source_is_ascii(emitter, lexer, begin, end);
+}
+
+void emitter_emit_batch(Emitter *emitter, const Lexer *lexer, const Token_Batch *batch)
+{
+    emitter_forget_statements(emitter);
+    emitter->batch_ascii = emitter_batch_is_ascii(emitter, lexer, batch);
+    for (size_t i = 0; i < batch->tokens_used; ++i) emitter_emit_token(emitter, lexer, &batch->tokens[i]);
+}
+
+void emitter_finish(Emitter *emitter)
+{
+    emitter_end_statement(emitter);
+    if (emitter->written > 0) fputc('\n', emitter->output);
+    fflush(emitter->output);
+}
+
+void transpiler_lex(Transpiler *transpiler, Token_Batch *batch)
+{
+    Lexer_Status status = lexer_tokenize_batch(transpiler->lexer, BATCH_SIZE, BATCH_LIMIT);
+    lexer_hand_over(transpiler->lexer, batch, status);
+}
+
+void transpiler_rewrite(Transpiler *transpiler, Token_Batch *batch)
+{
+    if (transpiler->rewrite && batch->status >= Lexer_Status__Ok) {
+        rewrite_batch(transpiler->lexer, batch, transpiler->dialect, &transpiler->report);
+    }
+}
+
+void transpiler_output(Transpiler *transpiler, const Token_Batch *batch)
+{
+    if (batch->status < Lexer_Status__Ok) return;
+
+    if (transpiler->emitter != NULL) emitter_emit_batch(transpiler->emitter, transpiler->lexer, batch);
+    else {
+        for (size_t i = 0; i < batch->tokens_used; ++i) {
+            printf("Token #%zu: ", transpiler->tokens_generated + i);
+            print_token(&batch->tokens[i]);
+            printf("\n");
+        }
+    }
+
+    transpiler->tokens_generated += batch->tokens_used;
+}
+
+Lexer_Status transpile_serially(Transpiler *transpiler)
+{
+    Token_Batch batch = {0};
+    do {
+        transpiler_lex(transpiler, &batch);
+        transpiler_rewrite(transpiler, &batch);
+        transpiler_output(transpiler, &batch);
+    } while (batch.status == Lexer_Status__Token_Found);
+
+    Lexer_Status status = batch.status;
+    token_batch_teardown(&batch);
+    return status;
+}
+
+/* The lexer only touches its own head and line state while the other stages only touch the batches handed to them
+ * and, for the rewriter, the input it reads through begin, so the stages share nothing but the rings. */
+void *transpiler_lex_stage(void *data)
+{
+    Transpiler *transpiler = data;
+    Batch_Ring *output = transpiler->rewrite ? &transpiler->lexed : &transpiler->rewritten;
+
+    Lexer_Status status;
+    do {
+        Token_Batch *batch = batch_ring_acquire_free(output);
+        transpiler_lex(transpiler, batch);
+        status = batch->status; /* The batch belongs to the next stage once published. */
+        batch_ring_publish(output);
+    } while (status == Lexer_Status__Token_Found);
+
+    return NULL;
+}
+
+void *transpiler_rewrite_stage(void *data)
+{
+    Transpiler *transpiler = data;
+
+    Lexer_Status status;
+    do {
+        Token_Batch *lexed = batch_ring_acquire_full(&transpiler->lexed);
+        Token_Batch *rewritten = batch_ring_acquire_free(&transpiler->rewritten);
+
+        /* Swapping leaves the lexed ring a batch with spare buffers for the lexer to reuse. */
+        Token_Batch swap = *rewritten;
+        *rewritten = *lexed;
+        *lexed = swap;
+        batch_ring_release(&transpiler->lexed);
+
+        transpiler_rewrite(transpiler, rewritten);
+        status = rewritten->status;
+        batch_ring_publish(&transpiler->rewritten);
+    } while (status == Lexer_Status__Token_Found);
+
+    return NULL;
+}
+
+/* Runs lexing, rewriting and output on their own threads, connected by rings that hold BATCH_RING_CAPACITY batches
+ * each, so a stage running ahead waits for the next instead of buffering the input. */
+Lexer_Status transpile_pipelined(Transpiler *transpiler)
+{
+    batch_ring_setup(&transpiler->lexed);
+    batch_ring_setup(&transpiler->rewritten);
+
+    pthread_t lex_thread, rewrite_thread;
+    int result = pthread_create(&lex_thread, NULL, transpiler_lex_stage, transpiler);
+    assert(result == 0);
+    if (transpiler->rewrite) {
+        result = pthread_create(&rewrite_thread, NULL, transpiler_rewrite_stage, transpiler);
+        assert(result == 0);
+    }
+    UNUSED(result);
+
+    Lexer_Status status;
+    do {
+        Token_Batch *batch = batch_ring_acquire_full(&transpiler->rewritten);
+        transpiler_output(transpiler, batch);
+        status = batch->status;
+        batch_ring_release(&transpiler->rewritten);
+    } while (status == Lexer_Status__Token_Found);
+
+    pthread_join(lex_thread, NULL);
+    if (transpiler->rewrite) pthread_join(rewrite_thread, NULL);
+
+    batch_ring_teardown(&transpiler->lexed);
+    batch_ring_teardown(&transpiler->rewritten);
+    return status;
+}
+
+void benchmark_input(const char *name, const char *input, size_t input_length)
+{
+    clock_t start = clock();
+    bool valid = utf8_is_valid(input, input_length);
+    double validate_seconds = (double)(clock() - start) / CLOCKS_PER_SEC;
+
+    start = clock();
+    Lexer lexer = {0};
+    lexer_setup(&lexer, input, input_length);
+
+    size_t tokens = 0;
+    Lexer_Status status;
+    do {
+        status = lexer_tokenize_batch(&lexer, BATCH_SIZE, BATCH_LIMIT);
+        tokens += lexer.tokens_used;
+        lexer_flush_tokens(&lexer);
+    } while (status == Lexer_Status__Token_Found);
+    double lex_seconds = (double)(clock() - start) / CLOCKS_PER_SEC;
+    lexer_teardown(&lexer);
+
+    double mebibytes = input_length / (1024.0 * 1024.0);
+    printf("%s: %.0f MiB, %s UTF-8, %s, x%zu tokens\n", name, mebibytes, valid ? "valid" : "invalid", lexer_status_name(status), tokens);
+    printf("    utf8_is_valid: %.3fs (%.0f MiB/s)\n", validate_seconds, mebibytes / validate_seconds);
+    printf("    lexing, validation included: %.3fs (%.0f MiB/s)\n", lex_seconds, mebibytes / lex_seconds);
+}
+
+/* Times UTF-8 validation and lexing over a pure ASCII input and a mixed one with localized identifiers. */
+int benchmark(void)
+{
+    const char *statements[][2] = {
+        {"ASCII", "SELECT player.id AS \"Player ID\", player.nick_name, SUM(match.score) AS total\n"
+                  "FROM game.player LEFT JOIN game.player_match match ON match.player_id = player.id\n"
+                  "WHERE player.status != 'inactive' AND player.rank >= 2000 GROUP BY player.id;\n"},
+        {"Mixed", "SELECT jogador.código AS \"Código\", jogador.apelido_名前, SUM(partida.pontuação) AS total\n"
+                  "FROM jogo.jogador LEFT JOIN jogo.partida_jogador partida ON partida.jogador_id = jogador.código\n"
+                  "WHERE jogador.situação != 'inativo' AND jogador.posição >= 2000 GROUP BY jogador.código;\n"},
+    };
+    const size_t input_length = 64 * 1024 * 1024;
+
+    char *input = malloc(input_length);
+    assert(input != NULL);
+
+    for (size_t i = 0; i < sizeof statements / sizeof statements[0]; ++i) {
+        size_t statement_length = strlen(statements[i][1]);
+        size_t used = 0;
+        while (used + statement_length <= input_length) {
+            memcpy(&input[used], statements[i][1], statement_length);
+            used += statement_length;
+        }
+        benchmark_input(statements[i][0], input, used);
+    }
+
+    free(input);
+    return EXIT_SUCCESS;
+}
+
+char *read_entire_file(const char *path, size_t *length)
+{
+    FILE *file = fopen(path, "rb");
+    if (file == NULL) return NULL;
+
+    size_t allocated = 4096;
+    char *content = malloc(allocated);
+    assert(content != NULL);
+
+    *length = 0;
+    size_t count;
+    while ((count = fread(&content[*length], 1, allocated - *length, file)) > 0) {
+        *length += count;
+        if (*length == allocated) {
+            allocated *= 2;
+            content = realloc(content, allocated);
+            assert(content != NULL);
+        }
+    }
+
+    bool failed = ferror(file);
+    fclose(file);
+    if (failed) {
+        free(content);
+        return NULL;
+    }
+
+    content[*length] = '\0'; /* The loop above always leaves room for it. */
+    return content;
+}
+
+/* Maps a file in so lexing starts on the first pages while the kernel reads the rest ahead. */
+const char *map_file(const char *path, size_t *length)
+{
+    int file = open(path, O_RDONLY);
+    if (file < 0) return NULL;
+
+    struct stat status;
+    if (fstat(file, &status) < 0) {
+        close(file);
+        return NULL;
+    }
+
+    *length = status.st_size;
+    if (*length == 0) { /* Empty files cannot be mapped. */
+        close(file);
+        return "";
+    }
+
+    void *content = mmap(NULL, *length, PROT_READ, MAP_PRIVATE, file, 0);
+    close(file);
+    if (content == MAP_FAILED) return NULL;
+
+    posix_madvise(content, *length, POSIX_MADV_SEQUENTIAL);
+    return content;
+}
+
+void unmap_file(const char *content, size_t length)
+{
+    if (content != NULL && length > 0) munmap((void *)content, length);
+}
+
+void print_usage(FILE *output)
+{
+    fprintf(output,
+        "Usage: ssql [OPTION...] [PATH]\n"
+        "  --minify           Emit minimal SQL instead of listing tokens.\n"
+        "  --deduplicate      Minify and drop statements repeated within the same batch of about %d tokens.\n"
+        "  --rewrite          Apply the rewrite rules of the dialect.\n"
+        "  --dialect=NAME     postgres (default), oracle or mysql.\n"
+        "  --source-map=PATH  Minify and write a source map to PATH.\n"
+        "  --lookup=POSITION  Print the line:column of a 1-based output position, given --source-map.\n"
+        "  --pipeline         Lex, rewrite and emit on separate threads.\n"
+        "  --benchmark        Time UTF-8 validation and lexing.\n",
+        BATCH_SIZE);
+}
+
+int main(int argc, char **argv)
+{
+    bool rewrite = false;
+    bool benchmark_mode = false;
+    bool minify = false;
+    bool deduplicate = false;
+    bool pipeline = false;
+    const char *path = NULL;
+    const char *source_map_path = NULL;
+    const char *lookup = NULL;
+    Dialect dialect = Dialect__Postgres;
+
+    for (int i = 1; i < argc; ++i) {
+        if (strcmp(argv[i], "--rewrite") == 0) rewrite = true;
+        else if (strcmp(argv[i], "--minify") == 0) minify = true;
+        else if (strcmp(argv[i], "--deduplicate") == 0) minify = deduplicate = true;
+        else if (strncmp(argv[i], "--source-map=", 13) == 0) {
+            source_map_path = argv[i] + 13;
+            minify = true;
+        } else if (strncmp(argv[i], "--lookup=", 9) == 0) lookup = argv[i] + 9;
+        else if (strcmp(argv[i], "--benchmark") == 0) benchmark_mode = true;
+        else if (strcmp(argv[i], "--pipeline") == 0) pipeline = true;
+        else if (strcmp(argv[i], "--help") == 0) {
+            print_usage(stdout);
+            return EXIT_SUCCESS;
+        }
+        else if (strncmp(argv[i], "--dialect=", 10) == 0) {
+            if (!dialect_parse(argv[i] + 10, &dialect)) {
+                fprintf(stderr, "Unknown dialect: %s\n", argv[i] + 10);
+                return EXIT_FAILURE;
+            }
+        } else if (argv[i][0] != '-' && path == NULL) path = argv[i];
+        else {
+            fprintf(stderr, "Unknown option: %s\n", argv[i]);
+            print_usage(stderr);
+            return EXIT_FAILURE;
+        }
+    }
+
+    if (benchmark_mode) return benchmark();
+
+    if (lookup != NULL) {
+        char *lookup_end;
+        size_t position = strtoull(lookup, &lookup_end, 10); /* 1-based character position, as databases report. */
+        if (source_map_path == NULL || lookup_end == lookup || *lookup_end != '\0' || position == 0) {
+            fprintf(stderr, "Usage: --source-map=PATH --lookup=POSITION\n");
+            return EXIT_FAILURE;
+        }
+
+        Source_Map map;
+        if (!source_map_load(&map, source_map_path)) {
+            fprintf(stderr, "Failed to load source map %s\n", source_map_path);
+            return EXIT_FAILURE;
+        }
+
+        Source_Mapping mapping;
+        bool found = source_map_lookup(&map, position - 1, &mapping);
+        if (found) printf("%" PRIu32 ":%" PRIu32 "\n", mapping.line + 1, mapping.column + 1);
+        else fprintf(stderr, "Position %zu is not mapped\n", position);
+
+        source_map_unload(&map);
+        return found ? EXIT_SUCCESS : EXIT_FAILURE;
+    }
+
+    const char *input =
+        "-- List players victories and scores.\n"
+        "SELECT\n"
+        "    player.id AS \"Player ID\", 1000 420.69 .55435 .545aasd \n"
+        "    player.nick_name AS \"Nickname\",\n"
+        "    AGE(CURRENT_TIMESTAMP, player.created_at) AS \"\"\"Account\"\" age\",\n"
+        "    SUM(match.score) AS \"Total Score\",\n"
+        "    COUNT(CASE WHEN match.state = 'won' THEN 1 END) AS \"Victories\"\n"
+        "FROM game.player\n"
+        "LEFT JOIN game.player_match match\n"
+        "    ON match.player_id = player.id\n"
+        "WHERE player.status != 'inac''tive'\n"
+        "    AND player.rank >= 2000\n"
+        "    /*AND player.rank BETWEEN 2000 AND 3000*/\n"
+        "    AND player.deleted_at IS NULL\n"
+        "GROUP BY player.id\n";
+    size_t input_length = strlen(input);
+
+    const char *content = NULL;
+    if (path != NULL) {
+        content = map_file(path, &input_length);
+        if (content == NULL) {
+            fprintf(stderr, "Failed to read %s\n", path);
+            return EXIT_FAILURE;
+        }
+        input = content;
+    }
+
+    Lexer lexer = {0};
+    lexer_setup(&lexer, input, input_length);
+
+    FILE *source_map_file = NULL;
+    Source_Map_Writer source_map;
+    if (source_map_path != NULL) {
+        source_map_file = fopen(source_map_path, "wb");
+        if (source_map_file == NULL) {
+            fprintf(stderr, "Failed to open %s\n", source_map_path);
+            lexer_teardown(&lexer);
+            unmap_file(content, input_length);
+            return EXIT_FAILURE;
+        }
+        source_map_writer_setup(&source_map, source_map_file);
+    }
+
+    Emitter emitter;
+    emitter_setup(&emitter, stdout, deduplicate, source_map_file != NULL ? &source_map : NULL);
+
+    Transpiler transpiler = {0};
+    transpiler.lexer = &lexer;
+    transpiler.rewrite = rewrite;
+    transpiler.dialect = dialect;
+    transpiler.emitter = minify ? &emitter : NULL;
+
+    Lexer_Status status = pipeline ? transpile_pipelined(&transpiler) : transpile_serially(&transpiler);
+    if (status < Lexer_Status__Ok) {
+        fprintf(stderr, "Failed to tokenize: %s\n", lexer_status_name(status));
+        if (source_map_file != NULL) fclose(source_map_file);
+        emitter_teardown(&emitter);
+        lexer_teardown(&lexer);
+        unmap_file(content, input_length);
+        return EXIT_FAILURE;
+    }
+
+    if (minify) {
+        emitter_finish(&emitter);
+        if (source_map_file != NULL) {
+            source_map_writer_finish(&source_map, emitter.written);
+            fclose(source_map_file);
+        }
+        if (deduplicate) fprintf(stderr, "Duplicate statements dropped: x%zu\n", emitter.statements_dropped);
+    } else fprintf(stderr, "Tokens generated: x%zu\n", transpiler.tokens_generated);
+
+    if (rewrite) {
+        for (Rewrite_Rule rule = 0; rule < Rewrite_Rule__Total; ++rule) {
+            if (transpiler.report.fired[rule] > 0) fprintf(stderr, "Rewrite %s fired (%s): x%zu\n", rewrite_rule_name(rule), dialect_name(dialect), transpiler.report.fired[rule]);
+        }
     }
 
+    emitter_teardown(&emitter);
     lexer_teardown(&lexer);
+    unmap_file(content, input_length);
     return EXIT_SUCCESS;
 }
@@ -0,0 +1,126 @@
+#!/bin/sh
+# Runs ssql over small inputs and compares its output with the expected SQL.
+set -u
+
+root=$(cd "$(dirname "$0")/.." && pwd)
+work=$(mktemp -d)
+trap 'rm -rf "$work"' EXIT
+
+cc -std=c11 -O2 -pthread -o "$work/ssql" "$root/ssql.c" || exit 1
+
+# Fill fresh heap memory with junk so reads of uninitialized bytes show up in the output (glibc).
+MALLOC_PERTURB_=202
+export MALLOC_PERTURB_
+
+failures=0
+
+# check NAME EXPECTED INPUT [OPTION...]
+check() {
+    name=$1
+    expected=$2
+    printf '%s' "$3" > "$work/input.ssql"
+    shift 3
+
+    actual=$("$work/ssql" "$@" "$work/input.ssql" 2>/dev/null)
+    if [ "$actual" = "$expected" ]; then
+        echo "ok: $name"
+    else
+        echo "FAIL: $name"
+        echo "    expected: $expected"
+        echo "    actual:   $actual"
+        failures=$((failures + 1))
+    fi
+}
+
+check "number at the end of the input" \
+    'SELECT 12,1.5e3,.5 e' \
+    'SELECT 12, 1.5e3, .5e' --minify
+
+check "text literals split over lines stay concatenated" \
+    "SELECT 'a'
+'b',\"x\" \"y\";" \
+    "SELECT 'a'
+    'b', \"x\" \"y\";" --minify
+
+check "middle dot continues identifiers" \
+    'SELECT a·b FROM t' \
+    'SELECT a·b FROM t' --minify
+
+check "strings may end the input" \
+    "SELECT 'a''b'AS \"c\"" \
+    "SELECT 'a''b' AS \"c\"" --minify
+
+check "errors stay out of the emitted SQL" \
+    "" \
+    "SELECT 1; SELECT 'a" --minify
+
+check "deduplicate drops repeated statements only" \
+    'SELECT 1;SELECT 2;' \
+    'SELECT 1; select  1; SELECT 2; -- again
+SELECT 1;' --deduplicate
+
+check "rewrite folds constants" \
+    'SELECT 3,x*2-12 FROM t' \
+    'SELECT 1 + 2, x * 2 - 3 * 4 FROM t' --minify --rewrite
+
+check "rewrite drops DISTINCT only over grouped columns and aggregates" \
+    'SELECT a,COUNT(*)AS n,1 FROM t GROUP BY a;SELECT DISTINCT a,unnest(x)FROM t GROUP BY a' \
+    'SELECT DISTINCT a, count(*) AS n, 1 FROM t GROUP BY a; SELECT DISTINCT a, unnest(x) FROM t GROUP BY a' --minify --rewrite
+
+check "rewrite keeps ORDER BY and GROUP BY positions" \
+    'SELECT a,COUNT(*)FROM t GROUP BY 2-1 ORDER BY 1+0 DESC,6+a,a+1;SELECT 3 FROM t ORDER BY 1*1' \
+    'SELECT a, count(*) FROM t GROUP BY 2 - 1 ORDER BY 1 + 0 DESC, 2 * 3 + a, a + 1; SELECT 1 + 2 FROM t ORDER BY 1 * 1' --minify --rewrite
+
+check "rewrite keeps parenthesized positions" \
+    'SELECT a,b FROM t ORDER BY(1+1),f(3),(2*2)+a' \
+    'SELECT a, b FROM t ORDER BY (1 + 1), f(1 + 2), (2 * 2) + a' --minify --rewrite
+
+check "rewrite keeps positions on mysql" \
+    'SELECT a FROM t GROUP BY 2-1 ORDER BY(SELECT 2)' \
+    'SELECT a FROM t GROUP BY 2 - 1 ORDER BY (SELECT 1 + 1)' --minify --rewrite --dialect=mysql
+
+# check_lookup NAME EXPECTED INPUT POSITION: maps a 1-based character position of the minified output back to
+# line:column of the input.
+check_lookup() {
+    printf '%s' "$3" > "$work/lookup.ssql"
+    "$work/ssql" --source-map="$work/lookup.map" "$work/lookup.ssql" > /dev/null 2>&1
+    check "$1" "$2" "" --source-map="$work/lookup.map" --lookup="$4"
+}
+
+check_lookup "two character operators map to their first character" \
+    '1:16' \
+    'SELECT a>=b, c <> d;' 14
+
+check_lookup "positions past the emitted SQL are not mapped" \
+    '' \
+    'SELECT a>=b, c <> d;' 18
+
+check_lookup "positions and columns count characters" \
+    '2:9' \
+    'SELECT "ação",
+  "名前", b;' 20
+
+# check_pipeline NAME INPUT_FILE [OPTION...]: the pipeline must print exactly what the serial run prints.
+check_pipeline() {
+    name=$1
+    input=$2
+    shift 2
+
+    "$work/ssql" "$@" "$input" > "$work/serial.out" 2>&1
+    "$work/ssql" --pipeline "$@" "$input" > "$work/pipeline.out" 2>&1
+    if cmp -s "$work/serial.out" "$work/pipeline.out"; then
+        echo "ok: $name"
+    else
+        echo "FAIL: $name"
+        failures=$((failures + 1))
+    fi
+}
+
+awk 'BEGIN { for (i = 0; i < 20000; ++i) printf "SELECT %d + %d, a FROM t%d ORDER BY 1 + 0; select  1;\n", i, i % 7, i % 3 }' > "$work/statements.ssql"
+awk 'BEGIN { printf "SELECT "; for (i = 0; i < 20000; ++i) printf "%d * 2 + c%d, ", i, i; print "0" }' > "$work/unterminated.ssql"
+
+check_pipeline "pipeline matches serial tokens" "$work/statements.ssql"
+check_pipeline "pipeline matches serial rewrites" "$work/statements.ssql" --rewrite --deduplicate
+check_pipeline "pipeline matches serial without semicolons" "$work/unterminated.ssql" --rewrite --minify
+
+[ "$failures" -eq 0 ]